@@ -0,0 +1,17 @@
+#!/usr/bin/env sh
+HERE="$(dirname ${0})"
+BUILD="${HERE}/builds"
+[ -d "${BUILD}" ] || mkdir -p "${BUILD}"
+
+# builds play-house-drum-pattern with the real-time safety guard of
+# src/play-house-drum-pattern/rt_guard.hpp, reporting to stderr every
+# allocation, lock, wait or system call made while rendering audio.
+#
+# -rdynamic names the functions of the stack traces, the others are
+# turned into names with addr2line -f -C -e <executable>
+#
+CPPFLAGS="${CPPFLAGS} -DQNTRX_RT_GUARD"
+CXXFLAGS="${CXXFLAGS} -DQNTRX_RT_GUARD"
+LDFLAGS="${LDFLAGS} -rdynamic -ldl"
+export CPPFLAGS CXXFLAGS LDFLAGS
+"${HERE}"/scripts/run.sh --top-dir "${HERE}" --src-dir "${HERE}"/src/play-house-drum-pattern "$@"
@@ -11,7 +11,6 @@
 #include <cstdarg>
 #include <cstdio>
 #include <cstdlib>
-#include <iterator>
 #include <limits>
 #include <string>
 #include <vector>
@@ -90,20 +89,12 @@ static std::vector<char> FormattedString(char const* format, ...)
 
 // global error reporting
 
-static std::vector<uint8_t> globalErrorBuffer;
-
-static bool internal_ensureErrorStringSequence()
-{
-        auto startIndex = globalErrorBuffer.size();
-        return startIndex == 0 || globalErrorBuffer[startIndex - 1] != '\0';
-}
+static DebugConsole globalErrorConsole;
 
 static void pushError(char const *string)
 {
         fprintf(stderr, "error:%s\n", string);
-        std::copy(string, string + strlen(string),
-                  std::back_inserter(globalErrorBuffer));
-        assert(internal_ensureErrorStringSequence());
+        globalErrorConsole.append(string);
 }
 
 static void pushFormattedError(char const *format, ...)
@@ -123,43 +114,19 @@ static void pushFormattedError(char const *format, ...)
                 va_list args;
                 va_copy(args, original_args);
                 auto neededCount = vsnprintf(0, 0, format, args);
+                va_end(args);
                 if (neededCount <= 0) {
+                        va_end(original_args);
                         return;
                 }
                 neededSize = neededCount;
-                va_end(args);
         }
 
-        auto startIndex = globalErrorBuffer.size();
-        globalErrorBuffer.reserve(1 + startIndex + neededSize); // for the \0
-        globalErrorBuffer.resize(startIndex + neededSize, 0);
-        assert(globalErrorBuffer.capacity() > globalErrorBuffer.size());
-
-        auto availableSize = globalErrorBuffer.capacity() - startIndex;
-
-        vsnprintf(reinterpret_cast<char*>(&globalErrorBuffer[startIndex]),
-                  availableSize,
-                  format,
-                  original_args);
-        assert(internal_ensureErrorStringSequence());
-
+        std::vector<char> message(1 + neededSize, 0); // +1 for the \0
+        vsnprintf(&message.front(), message.size(), format, original_args);
         va_end(original_args);
-}
-
-/// returns the string and whether it has truncated the string
-static std::pair<char const *,bool> getCurrentErrorString(size_t maxChars)
-{
-        auto lastCharacterIndex = globalErrorBuffer.size() - 1;
-        if (globalErrorBuffer[lastCharacterIndex] != '\0') {
-                globalErrorBuffer.emplace_back('\0');
-        }
 
-        auto startIndex = maxChars >= globalErrorBuffer.size() ? 0 :
-                          globalErrorBuffer.size() - maxChars;
-
-        return std::make_pair
-               (reinterpret_cast<char const*> (&globalErrorBuffer[startIndex]),
-                startIndex > 0);
+        globalErrorConsole.append(&message.front());
 }
 
 // program location
@@ -560,20 +527,30 @@ void render_next_gl3(uint64_t micros,
 
         auto modulation = 1.0f + 0.25f*float32Square(static_cast<float>(sin(
                                   TAU*seconds / 8.0f)));
-        if (globalErrorBuffer.size() > 0) {
-                auto message = getCurrentErrorString(draw_debug_string_maxchar());
+        if (globalErrorConsole.lineCount() > 0) {
                 auto backgroundColor = modulation * V3(0.66f, 0.17f, 0.12f);
                 glClearColor(backgroundColor.r, backgroundColor.g, backgroundColor.b, 0.0f);
                 glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
                 auto fb_width_px = display.framebuffer_width_px;
                 auto fb_height_px = display.framebuffer_height_px;
-                draw_debug_string(3.0f, 3.0f, "ERRORS:", 1, fb_width_px, fb_height_px);
-                auto lineY = 23.0f;
-                if (message.second) {
-                        draw_debug_string(3.0f, lineY, "(...)", 0, fb_width_px, fb_height_px);
-                        lineY += 10.0f;
+
+                // without input, page through the errors when they do not fit
+                auto const consoleY = 23.0f;
+                auto const consoleHeight = fb_height_px - consoleY;
+                uint64_t const rowN = DebugConsole::visibleRowCount(consoleHeight, 0);
+                auto const pageN = (globalErrorConsole.lineCount() + rowN - 1) / rowN;
+                if (pageN > 1) {
+                        auto const page = uint64_t(seconds / 4.0) % pageN;
+                        globalErrorConsole.scrollBack((pageN - 1 - page) * rowN);
+                        draw_debug_string_queue(3.0f, 3.0f,
+                                                &FormattedString("ERRORS: (%d/%d)",
+                                                                 int(page + 1),
+                                                                 int(pageN)).front(), 1);
+                } else {
+                        draw_debug_string_queue(3.0f, 3.0f, "ERRORS:", 1);
                 }
-                draw_debug_string(3.0f, lineY, message.first, 0, fb_width_px, fb_height_px);
+                globalErrorConsole.draw(3.0f, consoleY, consoleHeight, 0);
+                draw_debug_string_flush(fb_width_px, fb_height_px);
                 return;
         }
 
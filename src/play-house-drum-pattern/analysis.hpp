@@ -0,0 +1,303 @@
+#pragma once
+
+#include "real_fft.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+/**
+ * Hands the latest of a stream of values from one thread to another,
+ * neither ever waiting: the writer fills one slot while the reader
+ * holds another, and they trade through the third.
+ *
+ * The reader skips the values published in between its reads.
+ */
+template <typename T>
+class TripleBuffer
+{
+public:
+        /// the slot to fill before publish(), writer side
+        T& back()
+        {
+                return slots[back_index];
+        }
+
+        void publish()
+        {
+                back_index = middle.exchange(back_index | FRESH, std::memory_order_acq_rel) &
+                             INDEX_MASK;
+        }
+
+        /// writer side, @returns true once the last value published was taken
+        bool was_taken() const
+        {
+                return !(middle.load(std::memory_order_relaxed) & FRESH);
+        }
+
+        /**
+         * Takes the last published value, reader side.
+         *
+         * @returns false when nothing was published since the last
+         * update, in which case front() is unchanged
+         */
+        bool update()
+        {
+                if (!(middle.load(std::memory_order_relaxed) & FRESH)) {
+                        return false;
+                }
+                front_index = middle.exchange(front_index, std::memory_order_acq_rel) & INDEX_MASK;
+                return true;
+        }
+
+        /// the value taken by the last update, reader side
+        T const& front() const
+        {
+                return slots[front_index];
+        }
+
+private:
+        enum {
+                INDEX_MASK = 3,
+                /// set in middle by the writer, cleared by the reader
+                FRESH = 4,
+        };
+
+        T slots[3] = {};
+        int back_index = 0;
+        alignas(64) std::atomic<int> middle { 1 };
+        alignas(64) int front_index = 2;
+};
+
+/// what the visuals know of the audio
+struct AnalysisFrame {
+        enum {
+                FFT_N = 1024,
+                BIN_N = FFT_N / 2,
+        };
+
+        /// samples analysed up to this frame
+        uint64_t frame_count;
+        /// of the blocks since the last frame the visuals took, left and right
+        float rms[2];
+        float peak[2];
+        /// of the mono mix, over the last FFT_N samples, from 0 to just below Nyquist
+        float magnitudes[BIN_N];
+};
+
+/**
+ * Measures the blocks of the audio thread for the visuals.
+ *
+ * Levels are measured over every block since the visuals took their
+ * last frame, so that no peak goes unseen between two of their frames.
+ * The spectrum is measured every HOP_N samples, over a Hann window of
+ * FFT_N samples. Neither locks nor allocates.
+ *
+ * The spectrum is only transformed again once the render side took the
+ * last frame, so it costs nothing without visuals, and follows the
+ * frame rate of the visuals otherwise.
+ */
+class AudioAnalysis
+{
+public:
+        enum {
+                FFT_N = AnalysisFrame::FFT_N,
+                BIN_N = AnalysisFrame::BIN_N,
+                HOP_N = FFT_N / 2,
+        };
+
+        AudioAnalysis() : fft(FFT_N)
+        {
+                double const tau = 8.0 * std::atan(1.0);
+                double window_sum = 0.0;
+                for (int i = 0; i < FFT_N; i++) {
+                        window[i] = 0.5 - 0.5 * std::cos(tau * i / FFT_N);
+                        window_sum += window[i];
+                }
+                // a full scale sine reads as a magnitude of 1
+                for (auto& w : window) {
+                        w *= 2.0 / window_sum;
+                }
+        }
+
+        /// audio side
+        void feed(double const left[/*sample_count*/],
+                  double const right[/*sample_count*/],
+                  int const sample_count)
+        {
+                AnalysisFrame& frame = frames.back();
+                // a frame taken while this one is measured sees this block twice
+                if (frames.was_taken()) {
+                        std::fill_n(energy, 2, 0.0);
+                        std::fill_n(peak, 2, 0.0);
+                        level_sample_n = 0;
+                }
+                for (int i = 0; i < sample_count;) {
+                        int const n = std::min(sample_count - i, FFT_N - fill);
+                        for (int j = i; j < i + n; j++) {
+                                energy[0] += left[j] * left[j];
+                                energy[1] += right[j] * right[j];
+                                peak[0] = std::max(peak[0], std::fabs(left[j]));
+                                peak[1] = std::max(peak[1], std::fabs(right[j]));
+                                history[fill++] = 0.5 * (left[j] + right[j]);
+                        }
+                        i += n;
+                        if (fill == FFT_N) {
+                                if (frames.was_taken()) {
+                                        transform();
+                                }
+                                std::copy(&history[HOP_N], &history[FFT_N], &history[0]);
+                                fill = FFT_N - HOP_N;
+                        }
+                }
+                frame_count += uint64_t(sample_count);
+                level_sample_n += sample_count;
+
+                frame.frame_count = frame_count;
+                for (int c = 0; c < 2; c++) {
+                        frame.rms[c] = float(std::sqrt(energy[c] /
+                                                       double(std::max<int64_t>(1, level_sample_n))));
+                        frame.peak[c] = float(peak[c]);
+                }
+                std::copy_n(magnitudes, int(BIN_N), frame.magnitudes);
+                frames.publish();
+        }
+
+        /// render side, @see TripleBuffer::update
+        bool update()
+        {
+                return frames.update();
+        }
+
+        AnalysisFrame const& latest() const
+        {
+                return frames.front();
+        }
+
+private:
+        void transform()
+        {
+                for (int i = 0; i < FFT_N; i++) {
+                        windowed[i] = history[i] * window[i];
+                }
+                fft.forward(windowed, re, im);
+
+#if defined(__SSE2__) || defined(_M_X64)
+                static_assert(BIN_N % 4 == 0, "whole vectors of bins expected");
+                for (int k = 0; k < BIN_N; k += 4) {
+                        __m128d const r0 = _mm_loadu_pd(&re[k]);
+                        __m128d const i0 = _mm_loadu_pd(&im[k]);
+                        __m128d const r1 = _mm_loadu_pd(&re[k + 2]);
+                        __m128d const i1 = _mm_loadu_pd(&im[k + 2]);
+                        __m128d const m0 = _mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(r0, r0),
+                                                                  _mm_mul_pd(i0, i0)));
+                        __m128d const m1 = _mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(r1, r1),
+                                                                  _mm_mul_pd(i1, i1)));
+                        _mm_storeu_ps(&magnitudes[k], _mm_movelh_ps(_mm_cvtpd_ps(m0),
+                                                                    _mm_cvtpd_ps(m1)));
+                }
+#else
+                for (int k = 0; k < BIN_N; k++) {
+                        magnitudes[k] = float(std::sqrt(re[k] * re[k] + im[k] * im[k]));
+                }
+#endif
+        }
+
+        RealFft fft;
+        double window[FFT_N];
+        double history[FFT_N] = {};
+        int fill = 0;
+        double windowed[FFT_N];
+        double re[FFT_N / 2 + 1];
+        double im[FFT_N / 2 + 1];
+        float magnitudes[BIN_N] = {};
+        uint64_t frame_count = 0;
+        /// of the levels, since the last frame taken
+        double energy[2] = {};
+        double peak[2] = {};
+        int64_t level_sample_n = 0;
+
+        TripleBuffer<AnalysisFrame> frames;
+};
+
+/**
+ * Feeds AudioAnalysis with a sine and checks its measures, and that the
+ * triple buffer hands over the last frame.
+ *
+ * @returns true when they are as expected
+ */
+static bool analysis_check(FILE* report)
+{
+        int failure_n = 0;
+        auto expect = [&](bool condition, char const* what) {
+                if (!condition) {
+                        fprintf(report, "analysis: failed %s\n", what);
+                        failure_n++;
+                }
+        };
+
+        {
+                TripleBuffer<int> buffer;
+                expect(!buffer.update(), "nothing to read before publishing");
+                buffer.back() = 1;
+                buffer.publish();
+                buffer.back() = 2;
+                buffer.publish();
+                expect(buffer.update() && buffer.front() == 2, "the last value is read");
+                expect(!buffer.update() && buffer.front() == 2, "a value is only read once");
+        }
+
+        static AudioAnalysis analysis;
+        double const tau = 8.0 * std::atan(1.0);
+        int const sine_bin = 40;
+        // blocks of whole periods of the sine
+        double left[256];
+        double right[256];
+        for (int64_t i = 0; i < 4 * AudioAnalysis::FFT_N;) {
+                int const n = 256;
+                for (int j = 0; j < n; j++) {
+                        left[j] = 0.5 * std::sin(tau * sine_bin * double(i + j) /
+                                                 AudioAnalysis::FFT_N);
+                        right[j] = left[j];
+                }
+                analysis.feed(left, right, n);
+                expect(analysis.update(), "a frame is published per block");
+                i += n;
+        }
+        auto const& frame = analysis.latest();
+        expect(std::fabs(frame.rms[0] - 0.5 / std::sqrt(2.0)) < 1e-3 &&
+               std::fabs(frame.peak[1] - 0.5) < 1e-3, "levels are those of the sine");
+        int loudest = 0;
+        for (int k = 0; k < AnalysisFrame::BIN_N; k++) {
+                if (frame.magnitudes[k] > frame.magnitudes[loudest]) {
+                        loudest = k;
+                }
+        }
+        expect(loudest == sine_bin && std::fabs(frame.magnitudes[loudest] - 0.5) < 1e-3,
+               "the spectrum peaks at the sine");
+
+        {
+                // a click, then silence, before the visuals take a frame
+                std::fill_n(left, 256, 0.0);
+                std::fill_n(right, 256, 0.0);
+                left[0] = 1.0;
+                analysis.feed(left, right, 256);
+                left[0] = 0.0;
+                analysis.feed(left, right, 256);
+                expect(analysis.update() && analysis.latest().peak[0] == 1.0f &&
+                       std::fabs(analysis.latest().rms[0] - std::sqrt(1.0 / 512)) < 1e-6,
+                       "levels span the blocks since the last frame taken");
+                analysis.feed(left, right, 256);
+                expect(analysis.update() && analysis.latest().peak[0] == 0.0f,
+                       "levels restart once a frame is taken");
+        }
+
+        fprintf(report, "analysis: %s\n", failure_n == 0 ? "ok" : "FAILED");
+        return failure_n == 0;
+}
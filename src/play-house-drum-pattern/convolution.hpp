@@ -0,0 +1,535 @@
+#pragma once
+
+#include "real_fft.hpp"
+#include "spsc_ring.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+/**
+ * acc += a * b over n complex numbers, each stored as separate real and
+ * imaginary parts.
+ */
+static void complex_multiply_add(double acc_re[/*n*/],
+                                 double acc_im[/*n*/],
+                                 double const a_re[/*n*/],
+                                 double const a_im[/*n*/],
+                                 double const b_re[/*n*/],
+                                 double const b_im[/*n*/],
+                                 int const n)
+{
+        int i = 0;
+#if defined(__AVX__)
+        for (; i + 4 <= n; i += 4) {
+                __m256d const ar = _mm256_loadu_pd(&a_re[i]);
+                __m256d const ai = _mm256_loadu_pd(&a_im[i]);
+                __m256d const br = _mm256_loadu_pd(&b_re[i]);
+                __m256d const bi = _mm256_loadu_pd(&b_im[i]);
+                __m256d const re = _mm256_sub_pd(_mm256_mul_pd(ar, br), _mm256_mul_pd(ai, bi));
+                __m256d const im = _mm256_add_pd(_mm256_mul_pd(ar, bi), _mm256_mul_pd(ai, br));
+                _mm256_storeu_pd(&acc_re[i], _mm256_add_pd(_mm256_loadu_pd(&acc_re[i]), re));
+                _mm256_storeu_pd(&acc_im[i], _mm256_add_pd(_mm256_loadu_pd(&acc_im[i]), im));
+        }
+#endif
+#if defined(__AVX__) || defined(__SSE2__) || defined(_M_X64)
+        for (; i + 2 <= n; i += 2) {
+                __m128d const ar = _mm_loadu_pd(&a_re[i]);
+                __m128d const ai = _mm_loadu_pd(&a_im[i]);
+                __m128d const br = _mm_loadu_pd(&b_re[i]);
+                __m128d const bi = _mm_loadu_pd(&b_im[i]);
+                __m128d const re = _mm_sub_pd(_mm_mul_pd(ar, br), _mm_mul_pd(ai, bi));
+                __m128d const im = _mm_add_pd(_mm_mul_pd(ar, bi), _mm_mul_pd(ai, br));
+                _mm_storeu_pd(&acc_re[i], _mm_add_pd(_mm_loadu_pd(&acc_re[i]), re));
+                _mm_storeu_pd(&acc_im[i], _mm_add_pd(_mm_loadu_pd(&acc_im[i]), im));
+        }
+#endif
+        for (; i < n; i++) {
+                acc_re[i] += a_re[i] * b_re[i] - a_im[i] * b_im[i];
+                acc_im[i] += a_re[i] * b_im[i] + a_im[i] * b_re[i];
+        }
+}
+
+/**
+ * Convolves a signal with the channels of an impulse response cut in
+ * partitions of block_n samples, block by block (uniformly partitioned
+ * overlap-save).
+ *
+ * Every input block is transformed once and kept in a delay line of
+ * spectra, shared by the channels, which are multiplied with the
+ * spectra of the partitions and summed. Each block then costs one
+ * transform of 2 * block_n samples, plus one per channel, and one
+ * complex multiply-add per partition, channel and bin, whatever the
+ * length of the response.
+ */
+class PartitionedConvolver
+{
+public:
+        PartitionedConvolver(double const* const responses[/*channel_n*/],
+                             int const channel_n,
+                             int64_t const response_n,
+                             int const block_n) :
+                block_n(block_n),
+                channel_n(channel_n),
+                partition_n(int(std::max<int64_t>(1, (response_n + block_n - 1) / block_n))),
+                fft(2 * block_n),
+                bin_n(fft.bin_n()),
+                response_re(size_t(channel_n) * partition_n * bin_n),
+                response_im(size_t(channel_n) * partition_n * bin_n),
+                input_re(size_t(partition_n) * bin_n, 0.0),
+                input_im(size_t(partition_n) * bin_n, 0.0),
+                sum_re(bin_n),
+                sum_im(bin_n),
+                window(2 * block_n, 0.0),
+                output(2 * block_n)
+        {
+                std::vector<double> partition(2 * block_n);
+                for (int c = 0; c < channel_n; c++) {
+                        for (int p = 0; p < partition_n; p++) {
+                                std::fill(partition.begin(), partition.end(), 0.0);
+                                int64_t const start = int64_t(p) * block_n;
+                                int64_t const n = std::min<int64_t>(block_n, response_n - start);
+                                for (int64_t i = 0; i < n; i++) {
+                                        partition[i] = responses[c][start + i];
+                                }
+                                size_t const spectrum = (size_t(c) * partition_n + p) * bin_n;
+                                fft.forward(&partition.front(), &response_re[spectrum],
+                                            &response_im[spectrum]);
+                        }
+                }
+        }
+
+        int block_size() const
+        {
+                return block_n;
+        }
+
+        /**
+         * Convolves the next block_n samples of the input.
+         *
+         * @param outs receive the output of every channel for the same
+         * samples, which depends on them, and so is only known at the
+         * end of the block
+         */
+        void process(double const in[/*block_n*/], double* const outs[/*channel_n*/])
+        {
+                std::copy(window.begin() + block_n, window.end(), window.begin());
+                std::copy(in, in + block_n, window.begin() + block_n);
+
+                size_t const newest = size_t(newest_partition) * bin_n;
+                fft.forward(&window.front(), &input_re[newest], &input_im[newest]);
+
+                for (int c = 0; c < channel_n; c++) {
+                        std::fill(sum_re.begin(), sum_re.end(), 0.0);
+                        std::fill(sum_im.begin(), sum_im.end(), 0.0);
+                        for (int p = 0; p < partition_n; p++) {
+                                // the input block p blocks ago meets partition p
+                                int const age = (newest_partition - p + partition_n) % partition_n;
+                                size_t const input = size_t(age) * bin_n;
+                                size_t const response = (size_t(c) * partition_n + p) * bin_n;
+                                complex_multiply_add(&sum_re.front(), &sum_im.front(),
+                                                     &input_re[input], &input_im[input],
+                                                     &response_re[response], &response_im[response],
+                                                     bin_n);
+                        }
+                        // the first half wrapped around, the second half is valid
+                        fft.inverse(&sum_re.front(), &sum_im.front(), &output.front());
+                        std::copy(output.begin() + block_n, output.end(), outs[c]);
+                }
+                newest_partition = (newest_partition + 1) % partition_n;
+        }
+
+private:
+        int block_n;
+        int channel_n;
+        int partition_n;
+        RealFft fft;
+        int bin_n;
+        /// spectra of the partitions, channel after channel
+        std::vector<double> response_re;
+        std::vector<double> response_im;
+        /// spectra of the last partition_n input blocks
+        std::vector<double> input_re;
+        std::vector<double> input_im;
+        int newest_partition = 0;
+        std::vector<double> sum_re;
+        std::vector<double> sum_im;
+        /// the previous and current input blocks
+        std::vector<double> window;
+        std::vector<double> output;
+};
+
+/**
+ * A mono send convolved with a mono or stereo impulse response, with
+ * HEAD_BLOCK_N samples of latency.
+ *
+ * The response is partitioned non-uniformly: its head, the first
+ * HEAD_N samples, in blocks of HEAD_BLOCK_N convolved as the send
+ * comes, and its tail in blocks of TAIL_BLOCK_N. The tail of a block
+ * of send is only heard HEAD_N samples later, which leaves a whole
+ * TAIL_BLOCK_N to convolve it.
+ *
+ * That is done on a thread of its own once start_tail_thread() is
+ * called, otherwise as soon as a tail block is complete, which is
+ * deterministic, as needed offline. When the thread is late, the tail
+ * is missing from the output until it catches up, and counted as an
+ * underrun.
+ *
+ * process() neither locks nor allocates.
+ */
+class ConvolutionReverb
+{
+public:
+        enum {
+                HEAD_BLOCK_N = 256,
+                TAIL_BLOCK_N = 4096,
+                HEAD_N = 2 * TAIL_BLOCK_N,
+                MAX_CHANNEL_N = 2,
+                RING_N = 8 * TAIL_BLOCK_N,
+                IDLE_MICROS = 1000,
+        };
+
+        ~ConvolutionReverb()
+        {
+                stop_tail_thread();
+        }
+
+        /**
+         * Replaces the impulse response, responses[c] holding channel c.
+         * Neither real-time nor to be called while processing.
+         */
+        void load(double const* const responses[/*channel_n*/],
+                  int const channel_n,
+                  int64_t const response_n)
+        {
+                stop_tail_thread();
+                heads.clear();
+                tails.clear();
+                this->channel_n = std::min<int>(channel_n, MAX_CHANNEL_N);
+                has_tail = response_n > HEAD_N;
+                heads.emplace_back(responses, this->channel_n,
+                                   std::min<int64_t>(response_n, HEAD_N), HEAD_BLOCK_N);
+                if (has_tail) {
+                        double const* tail_responses[MAX_CHANNEL_N];
+                        for (int c = 0; c < this->channel_n; c++) {
+                                tail_responses[c] = responses[c] + HEAD_N;
+                        }
+                        tails.emplace_back(tail_responses, this->channel_n,
+                                           response_n - HEAD_N, TAIL_BLOCK_N);
+                }
+                send_fill = 0;
+                head_block_count = 0;
+                tail_fill = 0;
+                tail_debt_n = 0;
+                std::fill_n(&wet[0][0], MAX_CHANNEL_N * HEAD_BLOCK_N, 0.0);
+                Frame frame;
+                while (tail_outputs.pop(&frame)) {
+                }
+                double sample;
+                while (tail_sends.pop(&sample)) {
+                }
+        }
+
+        bool is_loaded() const
+        {
+                return channel_n > 0;
+        }
+
+        void start_tail_thread()
+        {
+                if (!has_tail || thread.joinable()) {
+                        return;
+                }
+                quit.store(false);
+                thread = std::thread([this]() {
+                        convolve_tails();
+                });
+        }
+
+        void stop_tail_thread()
+        {
+                if (thread.joinable()) {
+                        quit.store(true);
+                        thread.join();
+                }
+        }
+
+        uint64_t underruns() const
+        {
+                return underrun_n.load(std::memory_order_relaxed);
+        }
+
+        void process(double const send[/*sample_count*/],
+                     int const sample_count,
+                     double left[/*sample_count*/],
+                     double right[/*sample_count*/])
+        {
+                int const right_channel = channel_n > 1 ? 1 : 0;
+                for (int i = 0; i < sample_count;) {
+                        int const n = std::min(sample_count - i, HEAD_BLOCK_N - send_fill);
+                        std::copy_n(&send[i], n, &send_block[send_fill]);
+                        std::copy_n(&wet[0][send_fill], n, &left[i]);
+                        std::copy_n(&wet[right_channel][send_fill], n, &right[i]);
+                        send_fill += n;
+                        i += n;
+                        if (send_fill == HEAD_BLOCK_N) {
+                                process_block();
+                                send_fill = 0;
+                        }
+                }
+        }
+
+private:
+        struct Frame {
+                double channels[MAX_CHANNEL_N];
+        };
+
+        void process_block()
+        {
+                double* const wets[] = { wet[0], wet[1] };
+                heads.front().process(send_block, wets);
+                head_block_count++;
+                if (!has_tail) {
+                        return;
+                }
+
+                if (thread.joinable()) {
+                        if (tail_sends.push_n(send_block, HEAD_BLOCK_N) < HEAD_BLOCK_N) {
+                                underrun_n.fetch_add(1, std::memory_order_relaxed);
+                        }
+                } else {
+                        std::copy_n(send_block, int(HEAD_BLOCK_N), &tail_send[tail_fill]);
+                        tail_fill += HEAD_BLOCK_N;
+                        if (tail_fill == TAIL_BLOCK_N) {
+                                convolve_tail_block();
+                                tail_fill = 0;
+                        }
+                }
+
+                // the block just convolved is heard from the next one on
+                uint64_t const heard_n = head_block_count * HEAD_BLOCK_N;
+                if (heard_n <= HEAD_N) {
+                        return;
+                }
+                Frame frames[HEAD_BLOCK_N];
+                size_t const skipped_n = tail_outputs.pop_n(frames, std::min<uint64_t>(tail_debt_n,
+                                                                                        HEAD_BLOCK_N));
+                tail_debt_n -= skipped_n;
+                if (tail_debt_n > 0) {
+                        return;
+                }
+                size_t const popped_n = tail_outputs.pop_n(frames, HEAD_BLOCK_N);
+                if (popped_n < HEAD_BLOCK_N) {
+                        // the samples still to come belong to this block
+                        tail_debt_n = HEAD_BLOCK_N - popped_n;
+                        underrun_n.fetch_add(1, std::memory_order_relaxed);
+                        return;
+                }
+                for (int c = 0; c < channel_n; c++) {
+                        for (int i = 0; i < HEAD_BLOCK_N; i++) {
+                                wet[c][i] += frames[i].channels[c];
+                        }
+                }
+        }
+
+        /// convolves tail_send, on whichever thread convolves tails
+        void convolve_tail_block()
+        {
+                Frame* const frames = tail_frames;
+                double* const wets[] = { tail_wet[0], tail_wet[1] };
+                tails.front().process(tail_send, wets);
+                for (int c = 0; c < channel_n; c++) {
+                        for (int i = 0; i < TAIL_BLOCK_N; i++) {
+                                frames[i].channels[c] = tail_wet[c][i];
+                        }
+                }
+                // always fits: the audio side pops as fast as we push
+                tail_outputs.push_n(frames, TAIL_BLOCK_N);
+        }
+
+        void convolve_tails()
+        {
+                while (!quit.load(std::memory_order_relaxed)) {
+                        if (tail_sends.size() < TAIL_BLOCK_N) {
+                                std::this_thread::sleep_for(std::chrono::microseconds(IDLE_MICROS));
+                                continue;
+                        }
+                        tail_sends.pop_n(tail_send, TAIL_BLOCK_N);
+                        convolve_tail_block();
+                }
+        }
+
+        int channel_n = 0;
+        bool has_tail = false;
+        /// one, or none until loaded
+        std::vector<PartitionedConvolver> heads;
+        /// one, when the response is longer than HEAD_N
+        std::vector<PartitionedConvolver> tails;
+
+        /// audio side
+        double send_block[HEAD_BLOCK_N];
+        int send_fill = 0;
+        double wet[MAX_CHANNEL_N][HEAD_BLOCK_N] = {};
+        uint64_t head_block_count = 0;
+        /// tail samples to drop as they arrive, after an underrun
+        uint64_t tail_debt_n = 0;
+
+        /// tail side
+        double tail_send[TAIL_BLOCK_N];
+        int tail_fill = 0;
+        double tail_wet[MAX_CHANNEL_N][TAIL_BLOCK_N];
+        Frame tail_frames[TAIL_BLOCK_N];
+
+        SpscRing<double, RING_N> tail_sends;
+        SpscRing<Frame, RING_N> tail_outputs;
+        std::thread thread;
+        std::atomic<bool> quit { false };
+        std::atomic<uint64_t> underrun_n { 0 };
+};
+
+/**
+ * Fills response with decaying noise: reverberation dropping by 60 dB
+ * over decay_seconds, different for every seed.
+ */
+static void synthetic_impulse_response(double response[/*response_n*/],
+                                       int64_t const response_n,
+                                       double const decay_seconds,
+                                       uint32_t seed)
+{
+        double const decay_per_sample = std::log(1000.0) / (decay_seconds * 48000.0);
+        for (int64_t i = 0; i < response_n; i++) {
+                seed = seed * 1664525u + 1013904223u;
+                double const noise = 2.0 * (seed >> 8) / double(1 << 24) - 1.0;
+                response[i] = noise * std::exp(-decay_per_sample * double(i));
+        }
+}
+
+/// scales response to an energy of 1, which keeps the wet level comparable across responses
+static void normalize_impulse_response(double response[/*response_n*/], int64_t const response_n)
+{
+        double energy = 0.0;
+        for (int64_t i = 0; i < response_n; i++) {
+                energy += response[i] * response[i];
+        }
+        if (energy > 0.0) {
+                double const scale = 1.0 / std::sqrt(energy);
+                for (int64_t i = 0; i < response_n; i++) {
+                        response[i] *= scale;
+                }
+        }
+}
+
+/**
+ * Compares ConvolutionReverb with a direct convolution, convolving the
+ * tail inline and on its thread.
+ *
+ * @returns true when they agree
+ */
+static bool convolution_check(FILE* report)
+{
+        int failure_n = 0;
+        auto expect = [&](bool condition, char const* what) {
+                if (!condition) {
+                        fprintf(report, "convolution: failed %s\n", what);
+                        failure_n++;
+                }
+        };
+
+        {
+                RealFft fft(64);
+                double signal[64];
+                double re[33];
+                double im[33];
+                double back[64];
+                uint32_t seed = 1;
+                for (auto& sample : signal) {
+                        seed = seed * 1664525u + 1013904223u;
+                        sample = (seed >> 8) / double(1 << 24) - 0.5;
+                }
+                fft.forward(signal, re, im);
+                double const tau = 8.0 * std::atan(1.0);
+                double max_error = 0.0;
+                for (int k = 0; k <= 32; k++) {
+                        double dft_re = 0.0;
+                        double dft_im = 0.0;
+                        for (int i = 0; i < 64; i++) {
+                                dft_re += signal[i] * std::cos(tau * k * i / 64);
+                                dft_im -= signal[i] * std::sin(tau * k * i / 64);
+                        }
+                        max_error = std::max(max_error, std::fabs(dft_re - re[k]));
+                        max_error = std::max(max_error, std::fabs(dft_im - im[k]));
+                }
+                expect(max_error < 1e-12, "the transform is a DFT");
+                fft.inverse(re, im, back);
+                max_error = 0.0;
+                for (int i = 0; i < 64; i++) {
+                        max_error = std::max(max_error, std::fabs(back[i] - signal[i]));
+                }
+                expect(max_error < 1e-12, "the inverse transform inverts it");
+        }
+
+        int64_t const response_n = 3 * ConvolutionReverb::HEAD_N;
+        int64_t const sample_n = 6 * ConvolutionReverb::HEAD_N;
+        std::vector<double> response(response_n);
+        synthetic_impulse_response(&response.front(), response_n, 0.1, 7);
+        std::vector<double> send(sample_n);
+        synthetic_impulse_response(&send.front(), sample_n, 1.0, 11);
+
+        std::vector<double> expected(sample_n, 0.0);
+        for (int64_t i = ConvolutionReverb::HEAD_BLOCK_N; i < sample_n; i++) {
+                int64_t const n = i - ConvolutionReverb::HEAD_BLOCK_N;
+                double sum = 0.0;
+                for (int64_t j = std::max<int64_t>(0, n - response_n + 1); j <= n; j++) {
+                        sum += send[j] * response[n - j];
+                }
+                expected[i] = sum;
+        }
+
+        for (int threaded = 0; threaded < 2; threaded++) {
+                double const* const responses[] = { &response.front() };
+                ConvolutionReverb reverb;
+                reverb.load(responses, 1, response_n);
+                if (threaded) {
+                        reverb.start_tail_thread();
+                }
+                std::vector<double> left(sample_n);
+                std::vector<double> right(sample_n);
+                // in blocks of uneven sizes, at most a few per head block
+                int const sizes[] = { 1, 100, 37, 256, 19, 64 };
+                int64_t i = 0;
+                for (int b = 0; i < sample_n; b++) {
+                        int const n = int(std::min<int64_t>(sizes[b % 6], sample_n - i));
+                        reverb.process(&send[i], n, &left[i], &right[i]);
+                        i += n;
+                        if (threaded) {
+                                // as slow as real time, give or take
+                                std::this_thread::sleep_for(std::chrono::microseconds(n * 20));
+                        }
+                }
+                double max_error = 0.0;
+                for (int64_t s = 0; s < sample_n; s++) {
+                        max_error = std::max(max_error, std::fabs(left[s] - expected[s]));
+                        max_error = std::max(max_error, std::fabs(right[s] - expected[s]));
+                }
+                if (threaded) {
+                        expect(reverb.underruns() == 0 && max_error < 1e-9,
+                               "the threaded tail matches a direct convolution");
+                } else {
+                        expect(max_error < 1e-9, "it matches a direct convolution");
+                }
+        }
+
+        fprintf(report, "convolution: %s\n", failure_n == 0 ? "ok" : "FAILED");
+        return failure_n == 0;
+}
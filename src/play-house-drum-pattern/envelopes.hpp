@@ -0,0 +1,238 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+/**
+ * The sinexpenv envelope, advanced by recurrence for phases moving by
+ * a constant increment.
+ *
+ * Rather than evaluating sin and exp at every sample, the attack is
+ * obtained by rotating a (sin, cos) pair and the decay by multiplying
+ * it by a constant factor. The state is synchronized back with the
+ * closed form whenever the phase stops following its increment (the
+ * note phaser wrapped or was offset) and every RENORMALIZE_N samples,
+ * which bounds the accumulation of rounding errors.
+ *
+ * @param Math provides sin_turns, cos_turns and exp for the closed form
+ */
+template <typename Math>
+class SinExpEnvelope
+{
+public:
+        enum {
+                RENORMALIZE_N = 64,
+        };
+
+        /// @param previous_phase the phase before the first, if known
+        SinExpEnvelope(double attack_speed, double decay_speed,
+                       double previous_phase = std::numeric_limits<double>::quiet_NaN()) :
+                attack_speed(attack_speed),
+                decay_speed(decay_speed),
+                attack_dur(1.0 / attack_speed),
+                last_phase(previous_phase) {}
+
+        /// @returns the envelope at phase, the next phase of the note
+        double next(double phase)
+        {
+                double const increment = phase - last_phase;
+                if (countdown == 0 ||
+                    !(std::fabs(increment - state_increment) <= INCREMENT_TOLERANCE)) {
+                        sync(phase, increment);
+                } else {
+                        advance();
+                }
+                last_phase = phase;
+
+                double const attack = phase >= attack_dur ? 1.0 : std::fmax(0.0, attack_sin);
+                return attack * std::fmin(1.0, decay) * std::fmin(1.0, 1000.0 * (1.0 - phase));
+        }
+
+private:
+        /// how much two increments may differ and still be considered the same
+        static constexpr double INCREMENT_TOLERANCE = 1e-9;
+
+        void sync(double phase, double increment)
+        {
+                double const attack_turns = std::fmin(attack_dur, phase) * attack_speed / 4.0;
+                attack_sin = Math::sin_turns(attack_turns);
+                attack_cos = Math::cos_turns(attack_turns);
+                decay = Math::exp(-decay_speed * phase + decay_speed / attack_speed);
+                state_increment = increment;
+                countdown = RENORMALIZE_N;
+        }
+
+        void advance()
+        {
+                // only computed once an increment is seen twice in a row,
+                // which skips those measured across a wrap
+                if (state_increment != step_increment) {
+                        double const step_turns = state_increment * attack_speed / 4.0;
+                        step_sin = Math::sin_turns(step_turns);
+                        step_cos = Math::cos_turns(step_turns);
+                        step_decay = Math::exp(-decay_speed * state_increment);
+                        step_increment = state_increment;
+                }
+
+                double const s = attack_sin * step_cos + attack_cos * step_sin;
+                double const c = attack_cos * step_cos - attack_sin * step_sin;
+                attack_sin = s;
+                attack_cos = c;
+                decay *= step_decay;
+                countdown--;
+        }
+
+        double attack_speed;
+        double decay_speed;
+        double attack_dur;
+
+        double last_phase;
+        double state_increment = std::numeric_limits<double>::quiet_NaN();
+        int countdown = 0;
+
+        double attack_sin = 0.0;
+        double attack_cos = 1.0;
+        double decay = 1.0;
+
+        double step_increment = std::numeric_limits<double>::quiet_NaN();
+        double step_sin = 0.0;
+        double step_cos = 1.0;
+        double step_decay = 1.0;
+};
+
+template <typename Math>
+constexpr double SinExpEnvelope<Math>::INCREMENT_TOLERANCE;
+
+/**
+ * Math policy computing sinexpenv by recurrence with SinExpEnvelope,
+ * the rest being computed by the Math policy it extends.
+ *
+ * Envelopes start from the closed form at every block, so no state
+ * needs to be kept from one block to the next, and Math policies stay
+ * stateless. That start stands for one of the re-syncs SinExpEnvelope
+ * does every RENORMALIZE_N samples anyway: over blocks of 256 samples,
+ * keeping each voice's envelopes from one block to the next would save
+ * about 5% of the closed form evaluations, the step of the recurrence
+ * being computed again at every block.
+ */
+template <typename Math>
+struct IncrementalEnvelopes : Math {
+        static void sinexpenv_block(double const phases[], int n,
+                                    double attack_speed, double decay_speed,
+                                    double out[])
+        {
+                // the phase before the block, so that the first sync
+                // already knows the increment and the second sample
+                // does not sync again
+                double const previous_phase = n > 1 ? 2.0 * phases[0] - phases[1] :
+                                              std::numeric_limits<double>::quiet_NaN();
+                SinExpEnvelope<Math> envelope(attack_speed, decay_speed, previous_phase);
+                for (int i = 0; i < n; i++) {
+                        out[i] = envelope.next(phases[i]);
+                }
+        }
+};
+
+/**
+ * sinexpenv evaluated every period samples by Math, and interpolated
+ * in between.
+ *
+ * Between two evaluations, the envelope is interpolated linearly in
+ * the log domain, by a constant factor per sample. This is exact for
+ * the exponential decay, so only rounding separates it from
+ * evaluating every sample. A linear interpolation would lag above the
+ * convex decay, and the swept oscillators would integrate that error
+ * into their phase. Values that are not positive are interpolated
+ * linearly.
+ *
+ * The interpolation only spans samples where the envelope is smooth.
+ * The attack and the release ramp are evaluated at every sample, as
+ * are the samples next to them, and those around a phase which stops
+ * following its increment (the note phaser wrapped or was offset).
+ * Elsewhere the phase is linear in the sample index, so interpolating
+ * by index is interpolating the decay by phase.
+ *
+ * @param period samples between evaluations, 1 to evaluate all
+ */
+template <typename Math>
+static void control_rate_sinexpenv_block(double const phases[], int n,
+                                         double attack_speed, double decay_speed,
+                                         int period, double out[])
+{
+        if (period <= 1) {
+                Math::sinexpenv_block(phases, n, attack_speed, decay_speed, out);
+                return;
+        }
+
+        enum { CHUNK_N = 256 };
+        /// how much two increments may differ and still be considered the same
+        double const increment_tolerance = 1e-12;
+        double const attack_dur = 1.0 / attack_speed;
+        /// where the 1000 * (1 - phase) release ramp starts
+        double const release_start = 1.0 - 1.0 / 1000.0;
+
+        bool exact[CHUNK_N];
+        int points[CHUNK_N];
+        double point_phases[CHUNK_N];
+        double values[CHUNK_N];
+        for (int start = 0; start < n; start += CHUNK_N) {
+                int const chunk_n = std::min<int>(CHUNK_N, n - start);
+                double const* const chunk_phases = &phases[start];
+                double* const chunk_out = &out[start];
+
+                bool smooth[CHUNK_N];
+                for (int i = 0; i < chunk_n; i++) {
+                        double const phase = chunk_phases[i];
+                        smooth[i] = phase >= attack_dur && phase < release_start;
+                }
+                // including the samples on either side, to keep the kinks
+                for (int i = 0; i < chunk_n; i++) {
+                        exact[i] = !smooth[i] ||
+                                   (i > 0 && !smooth[i - 1]) ||
+                                   (i + 1 < chunk_n && !smooth[i + 1]);
+                }
+                exact[0] = true;
+                exact[chunk_n - 1] = true;
+                for (int i = 2; i < chunk_n; i++) {
+                        double const increment = chunk_phases[i] - chunk_phases[i - 1];
+                        double const previous = chunk_phases[i - 1] - chunk_phases[i - 2];
+                        if (!(std::fabs(increment - previous) <= increment_tolerance)) {
+                                exact[i - 1] = true;
+                                exact[i] = true;
+                        }
+                }
+
+                int point_n = 0;
+                for (int i = 0; i < chunk_n; i++) {
+                        if (exact[i] || point_n == 0 || i - points[point_n - 1] >= period) {
+                                points[point_n] = i;
+                                point_phases[point_n] = chunk_phases[i];
+                                point_n++;
+                        }
+                }
+                Math::sinexpenv_block(point_phases, point_n, attack_speed, decay_speed, values);
+
+                chunk_out[points[0]] = values[0];
+                for (int p = 1; p < point_n; p++) {
+                        int const a = points[p - 1];
+                        int const b = points[p];
+                        double const va = values[p - 1];
+                        double const vb = values[p];
+                        if (b - a > 1 && va > 0.0 && vb > 0.0) {
+                                double const factor = std::pow(vb / va, 1.0 / (b - a));
+                                double v = va;
+                                for (int i = a + 1; i < b; i++) {
+                                        v *= factor;
+                                        chunk_out[i] = v;
+                                }
+                        } else {
+                                double const slope = (vb - va) / (b - a);
+                                for (int i = a + 1; i < b; i++) {
+                                        chunk_out[i] = va + slope * (i - a);
+                                }
+                        }
+                        chunk_out[b] = vb;
+                }
+        }
+}
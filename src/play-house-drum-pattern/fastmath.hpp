@@ -0,0 +1,305 @@
+#pragma once
+
+/**
+ * @file
+ * Polynomial replacements for sin, cos and exp, as scalar functions
+ * and as SIMD kernels working on whole blocks.
+ *
+ * Sine and cosine take a normalized phase (in turns, 1.0 being a full
+ * cycle) as produced by Phasers, rather than radians.
+ *
+ * Maximum errors, measured against libm over their whole domain:
+ * - fast_sin_turns, fast_cos_turns: 5e-11 absolute
+ * - fast_exp: 3e-10 relative, for x in [-708, 709]
+ *
+ * The block kernels evaluate the same polynomials as the scalar
+ * functions, several values at a time.
+ */
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+namespace fastmath
+{
+/// adding then subtracting it rounds a double to the nearest integer
+static double const ROUNDING_MAGIC = 6755399441055744.0; // 1.5 * 2^52
+
+/// sin(2*pi*v)/v as a polynomial in v^2, for v in [0, 1/4]
+static double const SIN_C0 = 6.283185307133601653871e+00;
+static double const SIN_C1 = -4.134170214516588573797e+01;
+static double const SIN_C2 = 8.160522915541250783128e+01;
+static double const SIN_C3 = -7.670439924228767822334e+01;
+static double const SIN_C4 = 4.201180633905510366718e+01;
+static double const SIN_C5 = -1.440627072351574099966e+01;
+
+/// (exp(r) - 1 - r)/r^2 as a polynomial in r, for |r| <= ln(2)/2
+static double const EXP_C0 = 5.000000013462214522937e-01;
+static double const EXP_C1 = 1.666666671900771151313e-01;
+static double const EXP_C2 = 4.166646497613743074036e-02;
+static double const EXP_C3 = 8.333298480356525401549e-03;
+static double const EXP_C4 = 1.393364352182868512002e-03;
+static double const EXP_C5 = 1.989927622225405355220e-04;
+
+static double const LOG2E = 1.44269504088896340735992468100189214;
+static double const LN2_HI = 6.93147180369123816490e-01;
+static double const LN2_LO = 1.90821492927058770002e-10;
+static double const EXP_MIN_X = -708.0;
+static double const EXP_MAX_X = 709.0;
+}
+
+/// sin(2*pi*turns)
+static inline double fast_sin_turns(double turns)
+{
+        using namespace fastmath;
+        double const r = turns - ((turns + ROUNDING_MAGIC) - ROUNDING_MAGIC);
+        double const u = std::fabs(r);
+        double const v = u < 0.5 - u ? u : 0.5 - u;
+        double const w = v * v;
+        double const y = v * (SIN_C0 + w * (SIN_C1 + w * (SIN_C2 + w * (SIN_C3 + w *
+                                            (SIN_C4 + w * SIN_C5)))));
+        return r < 0.0 ? -y : y;
+}
+
+/// cos(2*pi*turns)
+static inline double fast_cos_turns(double turns)
+{
+        return fast_sin_turns(turns + 0.25);
+}
+
+static inline double fast_exp(double x)
+{
+        using namespace fastmath;
+        x = x < EXP_MIN_X ? EXP_MIN_X : (x > EXP_MAX_X ? EXP_MAX_X : x);
+        double const k = (x * LOG2E + ROUNDING_MAGIC) - ROUNDING_MAGIC;
+        double const r = (x - k * LN2_HI) - k * LN2_LO;
+        double const p = 1.0 + r + r * r * (EXP_C0 + r * (EXP_C1 + r * (EXP_C2 + r *
+                                            (EXP_C3 + r * (EXP_C4 + r * EXP_C5)))));
+        uint64_t const bits = static_cast<uint64_t>(static_cast<int64_t>(k) + 1023) << 52;
+        double scale;
+        std::memcpy(&scale, &bits, sizeof scale);
+        return p * scale;
+}
+
+#if defined(__AVX2__)
+static inline __m256d fast_sin_turns_avx2(__m256d turns)
+{
+        using namespace fastmath;
+        __m256d const magic = _mm256_set1_pd(ROUNDING_MAGIC);
+        __m256d const sign_mask = _mm256_set1_pd(-0.0);
+        __m256d const half = _mm256_set1_pd(0.5);
+        __m256d const r = _mm256_sub_pd(turns,
+                                        _mm256_sub_pd(_mm256_add_pd(turns, magic), magic));
+        __m256d const sign = _mm256_and_pd(r, sign_mask);
+        __m256d const u = _mm256_andnot_pd(sign_mask, r);
+        __m256d const v = _mm256_min_pd(u, _mm256_sub_pd(half, u));
+        __m256d const w = _mm256_mul_pd(v, v);
+        __m256d p = _mm256_set1_pd(SIN_C5);
+        p = _mm256_add_pd(_mm256_set1_pd(SIN_C4), _mm256_mul_pd(w, p));
+        p = _mm256_add_pd(_mm256_set1_pd(SIN_C3), _mm256_mul_pd(w, p));
+        p = _mm256_add_pd(_mm256_set1_pd(SIN_C2), _mm256_mul_pd(w, p));
+        p = _mm256_add_pd(_mm256_set1_pd(SIN_C1), _mm256_mul_pd(w, p));
+        p = _mm256_add_pd(_mm256_set1_pd(SIN_C0), _mm256_mul_pd(w, p));
+        return _mm256_xor_pd(_mm256_mul_pd(v, p), sign);
+}
+
+static inline __m256d fast_exp_avx2(__m256d x)
+{
+        using namespace fastmath;
+        __m256d const magic = _mm256_set1_pd(ROUNDING_MAGIC);
+        x = _mm256_min_pd(_mm256_max_pd(x, _mm256_set1_pd(EXP_MIN_X)),
+                          _mm256_set1_pd(EXP_MAX_X));
+        __m256d const t = _mm256_add_pd(_mm256_mul_pd(x, _mm256_set1_pd(LOG2E)), magic);
+        __m256d const k = _mm256_sub_pd(t, magic);
+        __m256d const r = _mm256_sub_pd(_mm256_sub_pd(x, _mm256_mul_pd(k,
+                                        _mm256_set1_pd(LN2_HI))),
+                                        _mm256_mul_pd(k, _mm256_set1_pd(LN2_LO)));
+        __m256d p = _mm256_set1_pd(EXP_C5);
+        p = _mm256_add_pd(_mm256_set1_pd(EXP_C4), _mm256_mul_pd(r, p));
+        p = _mm256_add_pd(_mm256_set1_pd(EXP_C3), _mm256_mul_pd(r, p));
+        p = _mm256_add_pd(_mm256_set1_pd(EXP_C2), _mm256_mul_pd(r, p));
+        p = _mm256_add_pd(_mm256_set1_pd(EXP_C1), _mm256_mul_pd(r, p));
+        p = _mm256_add_pd(_mm256_set1_pd(EXP_C0), _mm256_mul_pd(r, p));
+        p = _mm256_add_pd(_mm256_add_pd(_mm256_set1_pd(1.0), r),
+                          _mm256_mul_pd(_mm256_mul_pd(r, r), p));
+        // t holds k in its low mantissa bits, offset by those of magic
+        __m256i const exponent = _mm256_slli_epi64(
+                                         _mm256_add_epi64(_mm256_sub_epi64(_mm256_castpd_si256(t),
+                                                         _mm256_castpd_si256(magic)),
+                                                         _mm256_set1_epi64x(1023)), 52);
+        return _mm256_mul_pd(p, _mm256_castsi256_pd(exponent));
+}
+#endif
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+static inline __m128d fast_sin_turns_sse2(__m128d turns)
+{
+        using namespace fastmath;
+        __m128d const magic = _mm_set1_pd(ROUNDING_MAGIC);
+        __m128d const sign_mask = _mm_set1_pd(-0.0);
+        __m128d const half = _mm_set1_pd(0.5);
+        __m128d const r = _mm_sub_pd(turns, _mm_sub_pd(_mm_add_pd(turns, magic), magic));
+        __m128d const sign = _mm_and_pd(r, sign_mask);
+        __m128d const u = _mm_andnot_pd(sign_mask, r);
+        __m128d const v = _mm_min_pd(u, _mm_sub_pd(half, u));
+        __m128d const w = _mm_mul_pd(v, v);
+        __m128d p = _mm_set1_pd(SIN_C5);
+        p = _mm_add_pd(_mm_set1_pd(SIN_C4), _mm_mul_pd(w, p));
+        p = _mm_add_pd(_mm_set1_pd(SIN_C3), _mm_mul_pd(w, p));
+        p = _mm_add_pd(_mm_set1_pd(SIN_C2), _mm_mul_pd(w, p));
+        p = _mm_add_pd(_mm_set1_pd(SIN_C1), _mm_mul_pd(w, p));
+        p = _mm_add_pd(_mm_set1_pd(SIN_C0), _mm_mul_pd(w, p));
+        return _mm_xor_pd(_mm_mul_pd(v, p), sign);
+}
+
+static inline __m128d fast_exp_sse2(__m128d x)
+{
+        using namespace fastmath;
+        __m128d const magic = _mm_set1_pd(ROUNDING_MAGIC);
+        x = _mm_min_pd(_mm_max_pd(x, _mm_set1_pd(EXP_MIN_X)), _mm_set1_pd(EXP_MAX_X));
+        __m128d const t = _mm_add_pd(_mm_mul_pd(x, _mm_set1_pd(LOG2E)), magic);
+        __m128d const k = _mm_sub_pd(t, magic);
+        __m128d const r = _mm_sub_pd(_mm_sub_pd(x, _mm_mul_pd(k, _mm_set1_pd(LN2_HI))),
+                                     _mm_mul_pd(k, _mm_set1_pd(LN2_LO)));
+        __m128d p = _mm_set1_pd(EXP_C5);
+        p = _mm_add_pd(_mm_set1_pd(EXP_C4), _mm_mul_pd(r, p));
+        p = _mm_add_pd(_mm_set1_pd(EXP_C3), _mm_mul_pd(r, p));
+        p = _mm_add_pd(_mm_set1_pd(EXP_C2), _mm_mul_pd(r, p));
+        p = _mm_add_pd(_mm_set1_pd(EXP_C1), _mm_mul_pd(r, p));
+        p = _mm_add_pd(_mm_set1_pd(EXP_C0), _mm_mul_pd(r, p));
+        p = _mm_add_pd(_mm_add_pd(_mm_set1_pd(1.0), r), _mm_mul_pd(_mm_mul_pd(r, r), p));
+        // t holds k in its low mantissa bits, offset by those of magic
+        __m128i const exponent = _mm_slli_epi64(
+                                         _mm_add_epi64(_mm_sub_epi64(_mm_castpd_si128(t),
+                                                         _mm_castpd_si128(magic)),
+                                                       _mm_set1_epi64x(1023)), 52);
+        return _mm_mul_pd(p, _mm_castsi128_pd(exponent));
+}
+#endif
+
+/**
+ * Applies fn to n values, using the widest SIMD variant available
+ * for most of them.
+ */
+#if defined(__AVX2__)
+#define FASTMATH_BLOCK(fn, in, n, out)                                     \
+        do {                                                            \
+                int i_ = 0;                                             \
+                for (; i_ + 4 <= (n); i_ += 4) {                        \
+                        _mm256_storeu_pd(&(out)[i_],                    \
+                                         fn##_avx2(_mm256_loadu_pd(&(in)[i_]))); \
+                }                                                       \
+                for (; i_ + 2 <= (n); i_ += 2) {                        \
+                        _mm_storeu_pd(&(out)[i_],                       \
+                                      fn##_sse2(_mm_loadu_pd(&(in)[i_]))); \
+                }                                                       \
+                for (; i_ < (n); i_++) {                                \
+                        (out)[i_] = fn((in)[i_]);                       \
+                }                                                       \
+        } while (0)
+#elif defined(__SSE2__) || defined(_M_X64)
+#define FASTMATH_BLOCK(fn, in, n, out)                                     \
+        do {                                                            \
+                int i_ = 0;                                             \
+                for (; i_ + 2 <= (n); i_ += 2) {                        \
+                        _mm_storeu_pd(&(out)[i_],                       \
+                                      fn##_sse2(_mm_loadu_pd(&(in)[i_]))); \
+                }                                                       \
+                for (; i_ < (n); i_++) {                                \
+                        (out)[i_] = fn((in)[i_]);                       \
+                }                                                       \
+        } while (0)
+#else
+#define FASTMATH_BLOCK(fn, in, n, out)                                     \
+        do {                                                            \
+                for (int i_ = 0; i_ < (n); i_++) {                      \
+                        (out)[i_] = fn((in)[i_]);                       \
+                }                                                       \
+        } while (0)
+#endif
+
+static inline void fast_sin_turns_block(double const turns[], int n, double out[])
+{
+        FASTMATH_BLOCK(fast_sin_turns, turns, n, out);
+}
+
+/// cos(2*pi*turns), in-place operation allowed
+static inline void fast_cos_turns_block(double const turns[], int n, double out[])
+{
+        for (int i = 0; i < n; i++) {
+                out[i] = turns[i] + 0.25;
+        }
+        FASTMATH_BLOCK(fast_sin_turns, out, n, out);
+}
+
+static inline void fast_exp_block(double const x[], int n, double out[])
+{
+        FASTMATH_BLOCK(fast_exp, x, n, out);
+}
+
+/**
+ * Compares the fast functions with libm over their domain.
+ *
+ * @returns false when one exceeds its documented maximum error
+ */
+static bool fastmath_check(FILE* report)
+{
+        enum {
+                POINT_N = 1 << 20,
+                BLOCK_N = 67, // to exercise the non-SIMD tail
+        };
+        double const tau = 6.28318530717958647692528676655900576839433879875021;
+        double max_sin_error = 0.0;
+        double max_cos_error = 0.0;
+        double max_exp_error = 0.0;
+
+        double in[BLOCK_N], out[BLOCK_N];
+        for (int i = 0; i + BLOCK_N <= POINT_N; i += BLOCK_N) {
+                for (int j = 0; j < BLOCK_N; j++) {
+                        // phases of several cycles, both signs
+                        in[j] = -4.0 + 8.0 * (i + j) / POINT_N;
+                }
+
+                fast_sin_turns_block(in, BLOCK_N, out);
+                for (int j = 0; j < BLOCK_N; j++) {
+                        double const expected = std::sin(tau * in[j]);
+                        max_sin_error = std::fmax(max_sin_error,
+                                                  std::fmax(std::fabs(fast_sin_turns(in[j]) - expected),
+                                                            std::fabs(out[j] - expected)));
+                }
+
+                fast_cos_turns_block(in, BLOCK_N, out);
+                for (int j = 0; j < BLOCK_N; j++) {
+                        double const expected = std::cos(tau * in[j]);
+                        max_cos_error = std::fmax(max_cos_error,
+                                                  std::fmax(std::fabs(fast_cos_turns(in[j]) - expected),
+                                                            std::fabs(out[j] - expected)));
+                }
+
+                for (int j = 0; j < BLOCK_N; j++) {
+                        in[j] = fastmath::EXP_MIN_X + (fastmath::EXP_MAX_X - fastmath::EXP_MIN_X) *
+                                (i + j) / POINT_N;
+                }
+                fast_exp_block(in, BLOCK_N, out);
+                for (int j = 0; j < BLOCK_N; j++) {
+                        double const expected = std::exp(in[j]);
+                        max_exp_error = std::fmax(max_exp_error,
+                                                  std::fmax(std::fabs(fast_exp(in[j]) / expected - 1.0),
+                                                            std::fabs(out[j] / expected - 1.0)));
+                }
+        }
+
+        bool const ok = max_sin_error <= 5e-11 && max_cos_error <= 5e-11 &&
+                        max_exp_error <= 3e-10;
+        fprintf(report, "fast_sin_turns: max error %g\n", max_sin_error);
+        fprintf(report, "fast_cos_turns: max error %g\n", max_cos_error);
+        fprintf(report, "fast_exp: max relative error %g\n", max_exp_error);
+        return ok;
+}
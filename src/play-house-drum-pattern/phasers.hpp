@@ -0,0 +1,719 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+const double TAU = 6.28318530717958647692528676655900576839433879875021;
+
+/// the id returned when no phaser could be created
+const size_t PHASER_NONE = ~size_t(0);
+
+/**
+ * Wraps a phase after an increment back into ]-1, 1[
+ *
+ * Equivalent to fmod(x, 1.0) as long as |x| < 2, which always holds
+ * for a phase in ]-1, 1[ advanced by an increment in ]-1, 1[. Unlike
+ * fmod the subtraction is exact, so no drift is introduced.
+ */
+static inline double phaser_wrap(double x)
+{
+        return x >= 1.0 ? x - 1.0 : (x <= -1.0 ? x + 1.0 : x);
+}
+
+/// keeps increments in ]-1, 1[ so that phaser_wrap is exact
+static inline double phaser_wrap_increment(double increment)
+{
+        return std::fabs(increment) < 1.0 ? increment : fmod(increment, 1.0);
+}
+
+/**
+ * Phases and increments as doubles in turns, wrapped by phaser_wrap.
+ *
+ * An accumulator policy provides the Word phases and increments are
+ * stored in, their conversions from and to turns, and advance().
+ */
+struct DoublePhaseAccumulator {
+        typedef double Word;
+
+        static Word from_turns(double turns)
+        {
+                return turns;
+        }
+
+        static double to_turns(Word phase)
+        {
+                return phase;
+        }
+
+        static double increment_to_turns(Word increment)
+        {
+                return increment;
+        }
+
+        /// the increment of a follower advancing ratio times as fast
+        static Word scale_increment(Word increment, double ratio)
+        {
+                return phaser_wrap_increment(increment * ratio);
+        }
+
+        /**
+         * Advance count phasers by sample_count samples, recording each
+         * phaser's phase at every sample at streams[i*stride + k] when
+         * streams is not null.
+         *
+         * Phasers are independent, so lanes are taken across phasers
+         * rather than across time, which keeps the accumulation serial
+         * and identical to advancing one sample at a time.
+         */
+        static void advance(Word* phases,
+                            Word const* increments,
+                            size_t const count,
+                            size_t const sample_count,
+                            double* streams,
+                            size_t const stride)
+        {
+                size_t i = 0;
+#if defined(__AVX__)
+                {
+                        __m256d const one = _mm256_set1_pd(1.0);
+                        __m256d const minus_one = _mm256_set1_pd(-1.0);
+                        for (; i + 4 <= count; i += 4) {
+                                __m256d phase = _mm256_loadu_pd(&phases[i]);
+                                __m256d const increment = _mm256_loadu_pd(&increments[i]);
+                                for (size_t k = 0; k < sample_count; k++) {
+                                        if (streams) {
+                                                __m128d const lo = _mm256_castpd256_pd128(phase);
+                                                __m128d const hi = _mm256_extractf128_pd(phase, 1);
+                                                _mm_storel_pd(&streams[(i + 0)*stride + k], lo);
+                                                _mm_storeh_pd(&streams[(i + 1)*stride + k], lo);
+                                                _mm_storel_pd(&streams[(i + 2)*stride + k], hi);
+                                                _mm_storeh_pd(&streams[(i + 3)*stride + k], hi);
+                                        }
+                                        __m256d const x = _mm256_add_pd(phase, increment);
+                                        __m256d const over = _mm256_and_pd(
+                                                                     _mm256_cmp_pd(x, one, _CMP_GE_OQ), one);
+                                        __m256d const under = _mm256_and_pd(
+                                                                      _mm256_cmp_pd(x, minus_one, _CMP_LE_OQ), one);
+                                        phase = _mm256_add_pd(_mm256_sub_pd(x, over), under);
+                                }
+                                _mm256_storeu_pd(&phases[i], phase);
+                        }
+                }
+#endif
+#if defined(__AVX__) || defined(__SSE2__) || defined(_M_X64)
+                {
+                        __m128d const one = _mm_set1_pd(1.0);
+                        __m128d const minus_one = _mm_set1_pd(-1.0);
+                        for (; i + 2 <= count; i += 2) {
+                                __m128d phase = _mm_loadu_pd(&phases[i]);
+                                __m128d const increment = _mm_loadu_pd(&increments[i]);
+                                for (size_t k = 0; k < sample_count; k++) {
+                                        if (streams) {
+                                                _mm_storel_pd(&streams[(i + 0)*stride + k], phase);
+                                                _mm_storeh_pd(&streams[(i + 1)*stride + k], phase);
+                                        }
+                                        __m128d const x = _mm_add_pd(phase, increment);
+                                        __m128d const over = _mm_and_pd(_mm_cmpge_pd(x, one), one);
+                                        __m128d const under = _mm_and_pd(_mm_cmple_pd(x, minus_one), one);
+                                        phase = _mm_add_pd(_mm_sub_pd(x, over), under);
+                                }
+                                _mm_storeu_pd(&phases[i], phase);
+                        }
+                }
+#endif
+                for (; i < count; i++) {
+                        double phase = phases[i];
+                        double const increment = increments[i];
+                        for (size_t k = 0; k < sample_count; k++) {
+                                if (streams) {
+                                        streams[i*stride + k] = phase;
+                                }
+                                phase = phaser_wrap(phase + increment);
+                        }
+                        phases[i] = phase;
+                }
+        }
+};
+
+/**
+ * Phases and increments as unsigned fixed point numbers of turns, with
+ * all the bits of Word (uint32_t or uint64_t) after the point.
+ *
+ * Wrapping is the integer overflow, so phases are always in [0, 1[ and
+ * accumulate without any rounding: after n samples a phase is exactly
+ * n times its increment, modulo 1, however long the session. Only the
+ * increment is rounded, once, to the nearest 2^-bits of a turn.
+ *
+ * Negative increments are stored in two's complement.
+ */
+template <typename Word_>
+struct FixedPhaseAccumulator {
+        typedef Word_ Word;
+
+        static_assert(!std::numeric_limits<Word>::is_signed, "Word must be unsigned");
+
+        enum {
+                BITS = std::numeric_limits<Word>::digits,
+                /// bits dropped when converting to a double
+                EXCESS_BITS = BITS > 53 ? BITS - 53 : 0,
+        };
+
+        static Word from_turns(double turns)
+        {
+                double const fraction = turns - std::floor(turns);
+                double const scaled = std::ldexp(fraction, BITS);
+                // fraction may round up to 1.0 when turns is a tiny negative
+                return scaled >= std::ldexp(1.0, BITS) ? Word(0) : Word(scaled);
+        }
+
+        /// @returns the phase in [0, 1[
+        static double to_turns(Word phase)
+        {
+                // truncated to 53 bits, which may not round up to 1.0
+                return std::ldexp(double(phase >> EXCESS_BITS), EXCESS_BITS - BITS);
+        }
+
+        /// @returns an increment in [-1/2, 1/2[, to the precision of a double
+        static double to_signed_turns(Word increment)
+        {
+                typedef typename std::make_signed<Word>::type SignedWord;
+                return std::ldexp(double(SignedWord(increment)), -BITS);
+        }
+
+        /// @returns the index of phase in a table of 2^table_bits entries
+        static size_t table_index(Word phase, int table_bits)
+        {
+                return size_t(phase >> (BITS - table_bits));
+        }
+
+        static double increment_to_turns(Word increment)
+        {
+                return to_signed_turns(increment);
+        }
+
+        static Word scale_increment(Word increment, double ratio)
+        {
+                return from_turns(to_signed_turns(increment) * ratio);
+        }
+
+        /// as DoublePhaseAccumulator::advance, with integer lanes
+        static void advance(Word* phases,
+                            Word const* increments,
+                            size_t const count,
+                            size_t const sample_count,
+                            double* streams,
+                            size_t const stride)
+        {
+                if (!streams) {
+                        for (size_t i = 0; i < count; i++) {
+                                phases[i] += Word(sample_count) * increments[i];
+                        }
+                        return;
+                }
+
+                double const scale = std::ldexp(1.0, EXCESS_BITS - BITS);
+                size_t i = advance_vectors(phases, increments, count, sample_count, streams,
+                                           stride, scale);
+                for (; i < count; i++) {
+                        Word phase = phases[i];
+                        Word const increment = increments[i];
+                        double* const stream = &streams[i*stride];
+                        for (size_t k = 0; k < sample_count; k++) {
+                                // below 2^53, so converted exactly from a signed integer
+                                stream[k] = double(int64_t(phase >> EXCESS_BITS)) * scale;
+                                phase += increment;
+                        }
+                        phases[i] = phase;
+                }
+        }
+
+private:
+        /// only 64-bit words have vector lanes, with AVX2
+        template <typename OtherWord>
+        static size_t advance_vectors(OtherWord*, OtherWord const*, size_t, size_t, double*,
+                                      size_t, double)
+        {
+                return 0;
+        }
+
+#if defined(__AVX2__)
+        /**
+         * Advances the phasers up to the last multiple of four, four at a
+         * time. SSE2, two at a time, was not faster than the scalar loop.
+         *
+         * Without AVX-512 there is no conversion from 64-bit integers to
+         * doubles, so the 53 bits kept of each phase are converted in two
+         * halves of 32 bits, each OR'ed into the mantissa of a power of two
+         * which is then subtracted. Both halves convert exactly, and so
+         * does their sum, which stays below 2^53.
+         *
+         * @returns the number of phasers advanced
+         */
+        static size_t advance_vectors(uint64_t* phases,
+                                      uint64_t const* increments,
+                                      size_t const count,
+                                      size_t const sample_count,
+                                      double* streams,
+                                      size_t const stride,
+                                      double const scale)
+        {
+                // 2^84 and 2^52, whose mantissas receive the high and low halves
+                __m256i const high_exponent = _mm256_set1_epi64x(0x4530000000000000LL);
+                __m256i const low_exponent = _mm256_set1_epi64x(0x4330000000000000LL);
+                __m256d const high_offset = _mm256_set1_pd(19342813113834066795298816.0);
+                __m256d const low_offset = _mm256_set1_pd(4503599627370496.0);
+                __m256i const low_mask = _mm256_set1_epi64x(0xffffffffLL);
+                __m256d const scales = _mm256_set1_pd(scale);
+                size_t i = 0;
+                for (; i + 4 <= count; i += 4) {
+                        __m256i phase = _mm256_loadu_si256(
+                                                reinterpret_cast<__m256i const*>(&phases[i]));
+                        __m256i const increment = _mm256_loadu_si256(
+                                                          reinterpret_cast<__m256i const*>(&increments[i]));
+                        for (size_t k = 0; k < sample_count; k++) {
+                                __m256i const kept = _mm256_srli_epi64(phase, EXCESS_BITS);
+                                __m256i const high_bits = _mm256_or_si256(_mm256_srli_epi64(kept, 32),
+                                                                          high_exponent);
+                                __m256i const low_bits = _mm256_or_si256(_mm256_and_si256(kept, low_mask),
+                                                                         low_exponent);
+                                __m256d const high = _mm256_sub_pd(_mm256_castsi256_pd(high_bits),
+                                                                   high_offset);
+                                __m256d const low = _mm256_sub_pd(_mm256_castsi256_pd(low_bits),
+                                                                  low_offset);
+                                __m256d const turns = _mm256_mul_pd(_mm256_add_pd(high, low), scales);
+                                __m128d const lo = _mm256_castpd256_pd128(turns);
+                                __m128d const hi = _mm256_extractf128_pd(turns, 1);
+                                _mm_storel_pd(&streams[(i + 0)*stride + k], lo);
+                                _mm_storeh_pd(&streams[(i + 1)*stride + k], lo);
+                                _mm_storel_pd(&streams[(i + 2)*stride + k], hi);
+                                _mm_storeh_pd(&streams[(i + 3)*stride + k], hi);
+                                phase = _mm256_add_epi64(phase, increment);
+                        }
+                        _mm256_storeu_si256(reinterpret_cast<__m256i*>(&phases[i]), phase);
+                }
+                return i;
+        }
+#endif
+};
+
+/**
+ * A set of values going from 0 to 1 at various speeds, representing
+ * various cycles in the passage of time.
+ *
+ * They can be used to scan wavetables or be fed to functions such as
+ * sin/cos etc.. to produce oscillators or envelopes.
+ *
+ * Phases and increments are stored as separate arrays so that they
+ * can be advanced several phasers at a time with SIMD instructions.
+ *
+ * All storage is allocated at construction for up to capacity phasers
+ * and blocks of up to max_block_sample_n samples. Destroyed phasers
+ * go to a free list and get reused by the next create, so phasers can
+ * come and go while the audio thread runs.
+ *
+ * Followers are kept sorted by depth, a follower coming after the
+ * phaser it follows, so that one pass propagates increments through
+ * chains of any depth. Only the followers of phasers changed since
+ * the last advance are updated, once for however many changes.
+ *
+ * Phases are accumulated as defined by Accumulator, either
+ * DoublePhaseAccumulator or FixedPhaseAccumulator. Either way they are
+ * read and written as doubles in turns.
+ */
+template <typename Accumulator>
+class BasicPhasers
+{
+public:
+        typedef typename Accumulator::Word Word;
+
+        enum {
+                DEFAULT_CAPACITY = 256,
+                DEFAULT_MAX_BLOCK_SAMPLE_N = 256,
+        };
+
+        explicit BasicPhasers(size_t capacity = DEFAULT_CAPACITY,
+                              size_t max_block_sample_n = DEFAULT_MAX_BLOCK_SAMPLE_N) :
+                phases(capacity, Word(0)),
+                increments(capacity, Word(0)),
+                streams(capacity * max_block_sample_n, 0.0),
+                stream_stride(max_block_sample_n),
+                dirty(capacity, 0)
+        {
+                free_ids.reserve(capacity);
+                followers.reserve(capacity);
+        }
+
+        size_t create(double frequency, double offset = 0.0)
+        {
+                size_t id;
+                if (!free_ids.empty()) {
+                        id = free_ids.back();
+                        free_ids.pop_back();
+                } else if (used_n < phases.size()) {
+                        id = used_n++;
+                } else {
+                        return PHASER_NONE;
+                }
+                phases[id] = Accumulator::from_turns(offset);
+                increments[id] = Accumulator::from_turns(to_increment(frequency));
+                mark_dirty(id);
+                return id;
+        }
+
+        size_t create_follower(size_t main, double ratio = 1.0, double offset = 0.0)
+        {
+                size_t const id = create(0.0, offset);
+                if (id != PHASER_NONE) {
+                        size_t depth = 0;
+                        for (auto const& follower : followers) {
+                                if (follower.id == main) {
+                                        depth = follower.depth + 1;
+                                }
+                        }
+                        // after the other followers at that depth,
+                        // which keeps creation order within a depth
+                        auto it = followers.begin();
+                        while (it != followers.end() && it->depth <= depth) {
+                                ++it;
+                        }
+                        followers.insert(it, follower_state(id, main, ratio, depth));
+                }
+                return id;
+        }
+
+        /// returns phaser to the free list, once nothing follows it
+        void destroy(size_t phaser)
+        {
+                assert(phaser < used_n);
+                auto follower = followers.end();
+                for (auto it = followers.begin(); it != followers.end(); ++it) {
+                        assert(it->main != phaser);
+                        if (it->id == phaser) {
+                                follower = it;
+                        }
+                }
+                if (follower != followers.end()) {
+                        // keeping followers sorted
+                        followers.erase(follower);
+                }
+                // a free phaser is still advanced, but stays still
+                phases[phaser] = Word(0);
+                increments[phaser] = Word(0);
+                free_ids.push_back(phaser);
+        }
+
+        /// @returns how many more phasers may be created
+        size_t available() const
+        {
+                return phases.size() - used_n + free_ids.size();
+        }
+
+        void change(size_t phaser, double frequency)
+        {
+                increments[phaser] = Accumulator::from_turns(to_increment(frequency));
+                mark_dirty(phaser);
+        }
+
+        void offset(size_t phaser, double offset)
+        {
+                phases[phaser] = Accumulator::from_turns(offset);
+        }
+
+        /// sets the increment directly, as obtained from to_increment
+        void increment(size_t phaser, double increment)
+        {
+                increments[phaser] = Accumulator::from_turns(increment);
+                mark_dirty(phaser);
+        }
+
+        double get_increment(size_t phaser) const
+        {
+                return Accumulator::increment_to_turns(increments[phaser]);
+        }
+
+        double get(int phaser) const
+        {
+                return Accumulator::to_turns(phases[phaser]);
+        }
+
+        double get_radians(int phaser) const
+        {
+                return get(phaser) * TAU;
+        }
+
+        /// the phase as stored by the Accumulator
+        Word get_word(size_t phaser) const
+        {
+                return phases[phaser];
+        }
+
+        void advance()
+        {
+                update_followers();
+                Accumulator::advance(phases.data(), increments.data(),
+                                     used_n, 1, nullptr, 0);
+        }
+
+        /**
+         * Advance all phasers by sample_count samples at once, using
+         * the increments in place when called.
+         *
+         * The phase each phaser had at every sample of the block is
+         * recorded and available through stream() until the next call.
+         *
+         * Code rendering a block may then integrate some phasers on
+         * its own, starting from stream(phaser)[0], and write back its
+         * final state using offset() and increment().
+         */
+        void advance_block(int sample_count)
+        {
+                assert(sample_count >= 0);
+                size_t const n = sample_count;
+                assert(n <= stream_stride);
+
+                update_followers();
+                Accumulator::advance(phases.data(), increments.data(),
+                                     used_n, n, streams.data(), stream_stride);
+        }
+
+        /**
+         * Advance all phasers by sample_count samples, as advance_block
+         * would, without recording their phases.
+         *
+         * With FixedPhaseAccumulator this takes the same time however
+         * many samples are skipped.
+         */
+        void skip(uint64_t sample_count)
+        {
+                update_followers();
+                Accumulator::advance(phases.data(), increments.data(),
+                                     used_n, size_t(sample_count), nullptr, 0);
+        }
+
+        /// the state of phasers, between two advances
+        struct Snapshot {
+                size_t phaser_n;
+                Word phases[DEFAULT_CAPACITY];
+                Word increments[DEFAULT_CAPACITY];
+
+                /// @returns the phasers whose state differs in any bit
+                size_t diff(Snapshot const& other) const
+                {
+                        size_t n = phaser_n == other.phaser_n ? 0 : 1;
+                        for (size_t i = 0; i < phaser_n && i < other.phaser_n; i++) {
+                                n += phases[i] != other.phases[i] ||
+                                     increments[i] != other.increments[i];
+                        }
+                        return n;
+                }
+        };
+
+        /**
+         * Followers are updated first, as the next advance would, so
+         * that the increments saved are the ones it will use.
+         */
+        void snapshot(Snapshot* snapshot)
+        {
+                assert(used_n <= DEFAULT_CAPACITY);
+                update_followers();
+                snapshot->phaser_n = used_n;
+                std::copy_n(phases.begin(), used_n, snapshot->phases);
+                std::copy_n(increments.begin(), used_n, snapshot->increments);
+        }
+
+        /// into phasers created, and followed, as when the snapshot was taken
+        void restore(Snapshot const& snapshot)
+        {
+                assert(snapshot.phaser_n == used_n);
+                std::copy_n(snapshot.phases, used_n, phases.begin());
+                std::copy_n(snapshot.increments, used_n, increments.begin());
+                std::fill_n(dirty.begin(), used_n, 0);
+        }
+
+        /// @returns the phases of the last advance_block call for phaser
+        double const* stream(size_t phaser) const
+        {
+                return &streams[phaser * stream_stride];
+        }
+
+        /**
+         * @returns true when phaser follows main, and then its ratio
+         */
+        bool follows(size_t phaser, size_t main, double* ratio) const
+        {
+                for (auto const& follower : followers) {
+                        if (follower.id == phaser && follower.main == main) {
+                                *ratio = follower.ratio;
+                                return true;
+                        }
+                }
+                return false;
+        }
+
+        static double to_increment(double frequency)
+        {
+                return phaser_wrap_increment(frequency / 48000.0);
+        }
+
+private:
+        /**
+         * A changed follower gets its increment back from its main.
+         *
+         * One flag per phaser, so that threads changing different
+         * phasers do not share anything.
+         */
+        void mark_dirty(size_t phaser)
+        {
+                dirty[phaser] = 1;
+        }
+
+        void update_followers()
+        {
+                for (auto const& follower : followers) {
+                        if (dirty[follower.main] || dirty[follower.id]) {
+                                increments[follower.id] = Accumulator::scale_increment(
+                                                                  increments[follower.main], follower.ratio);
+                                dirty[follower.id] = 1;
+                        }
+                }
+                std::fill_n(dirty.begin(), used_n, 0);
+        }
+
+        std::vector<Word> phases;
+        std::vector<Word> increments;
+
+        std::vector<double> streams;
+        size_t stream_stride;
+
+        /// phasers [0, used_n) have been created once
+        size_t used_n = 0;
+        std::vector<size_t> free_ids;
+
+        std::vector<unsigned char> dirty;
+
+        struct follower_state {
+                size_t id;
+                size_t main;
+                double ratio;
+                /// 0 when main is no follower
+                size_t depth;
+
+                follower_state(size_t id, size_t main, double ratio, size_t depth) :
+                        id(id),
+                        main(main),
+                        ratio(ratio),
+                        depth(depth) {}
+        };
+
+        std::vector<follower_state> followers;
+};
+
+typedef BasicPhasers<DoublePhaseAccumulator> Phasers;
+
+/// phases accumulated without rounding, see FixedPhaseAccumulator
+typedef BasicPhasers<FixedPhaseAccumulator<uint64_t>> FixedPhasers;
+
+/**
+ * Compares FixedPhasers to the exact phases they should reach, and
+ * checks that the pool of Phasers hands out and takes back its ids.
+ *
+ * @returns true when fixed point phases accumulate without error
+ */
+static bool phasers_check(FILE* report)
+{
+        int failure_n = 0;
+        auto expect = [&](bool condition, char const* what) {
+                if (!condition) {
+                        fprintf(report, "phasers: failed %s\n", what);
+                        failure_n++;
+                }
+        };
+
+        typedef FixedPhaseAccumulator<uint64_t> Fixed64;
+        typedef FixedPhaseAccumulator<uint32_t> Fixed32;
+
+        {
+                // an hour of samples, in blocks
+                size_t const block_n = 1024;
+                uint64_t const block_count = 3600ULL * 48000 / block_n;
+                FixedPhasers phasers(4, block_n);
+                size_t const osc = phasers.create(440.0);
+                size_t const down = phasers.create(-13.0);
+                uint64_t const osc_increment = Fixed64::from_turns(FixedPhasers::to_increment(440.0));
+                uint64_t const down_increment = Fixed64::from_turns(FixedPhasers::to_increment(-13.0));
+                bool in_range = true;
+                for (uint64_t b = 0; b < block_count; b++) {
+                        phasers.advance_block(block_n);
+                        for (size_t k = 0; k < block_n; k++) {
+                                double const phase = phasers.stream(down)[k];
+                                in_range = in_range && phase >= 0.0 && phase < 1.0;
+                        }
+                }
+                uint64_t const sample_n = block_count * block_n;
+                expect(phasers.get_word(osc) == sample_n * osc_increment,
+                       "phase is exactly n times its increment");
+                expect(phasers.get_word(down) == sample_n * down_increment,
+                       "negative increments wrap too");
+                expect(in_range, "streams stay in [0, 1[");
+                expect(phasers.get_increment(down) < 0.0, "increments keep their sign");
+        }
+
+        {
+                FixedPhasers phasers(4, 16);
+                size_t const main = phasers.create(100.0);
+                size_t const follower = phasers.create_follower(main, 2.0);
+                phasers.advance_block(16);
+                phasers.advance_block(16);
+                double const ratio = phasers.get_increment(follower) / phasers.get_increment(main);
+                expect(std::fabs(ratio - 2.0) < 1e-9, "followers follow");
+                expect(phasers.get_word(follower) == 2 * phasers.get_word(main),
+                       "followers advance at their ratio");
+        }
+
+        {
+                uint32_t phase = Fixed32::from_turns(0.75);
+                expect(Fixed32::table_index(phase, 10) == 768, "phases index tables");
+                phase += Fixed32::from_turns(0.5);
+                expect(Fixed32::to_turns(phase) == 0.25, "32 bit phases wrap");
+                expect(Fixed32::from_turns(-0.25) == Fixed32::from_turns(0.75),
+                       "negative turns wrap");
+                expect(Fixed64::from_turns(-1e-300) == 0, "tiny negative turns round to 0");
+        }
+
+        {
+                Phasers phasers(3, 16);
+                size_t const a = phasers.create(100.0);
+                size_t const b = phasers.create_follower(a, 0.5);
+                size_t const c = phasers.create(200.0);
+                expect(phasers.available() == 0 && phasers.create(1.0) == PHASER_NONE,
+                       "a full pool refuses phasers");
+                phasers.destroy(c);
+                phasers.destroy(b);
+                expect(phasers.available() == 2, "destroyed phasers return to the pool");
+                size_t const d = phasers.create(300.0);
+                expect(d == b || d == c, "destroyed ids are reused");
+                phasers.advance_block(16);
+                expect(phasers.get(d) > 0.0, "reused phasers move again");
+
+                Phasers empty(0, 0);
+                empty.advance();
+                empty.advance_block(0);
+                expect(empty.create(1.0) == PHASER_NONE, "empty pools advance and stay empty");
+        }
+
+        fprintf(report, "phasers: %s\n", failure_n == 0 ? "ok" : "FAILED");
+        return failure_n == 0;
+}
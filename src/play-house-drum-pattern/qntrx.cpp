@@ -1,90 +1,41 @@
+#include "analysis.hpp"
+#include "convolution.hpp"
+#include "envelopes.hpp"
+#include "fastmath.hpp"
+#include "phasers.hpp"
+#include "regression.hpp"
+#include "render_ahead.hpp"
+#include "rt_guard.hpp"
+#include "sequencer.hpp"
+#include "spsc_ring.hpp"
+#include "voice_stages.hpp"
+#include "wav_reader.hpp"
+#include "wav_writer.hpp"
+#include "workers.hpp"
+
 #include <micros/api.h>
 #include <micros/gl3.h>
 
-#include <vector>
+#include <algorithm>
+#include <cassert>
+#include <chrono>
 #include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
 
-const double TAU = 6.28318530717958647692528676655900576839433879875021;
-
-/**
- * A set of values going from 0 to 1 at various speeds, representing
- * various cycles in the passage of time.
- *
- * They can be used to scan wavetables or be fed to functions such as
- * sin/cos etc.. to produce oscillators or envelopes.
- */
-class Phasers
-{
-public:
-        size_t create(double frequency, double offset = 0.0)
-        {
-                size_t const id = data.size();
-                data.emplace_back(offset, frequency / 48000.0);
-                return id;
-        }
-
-        size_t create_follower(size_t main, double ratio = 1.0, double offset = 0.0)
-        {
-                size_t const id = create(0.0, offset);
-                followers.emplace_back(id, main, ratio);
-                return id;
-        }
-
-        void change(size_t phaser, double frequency)
-        {
-                data[phaser].increment = frequency / 48000.0;
-        }
-
-        void offset(size_t phaser, double offset)
-        {
-                data[phaser].phase = offset;
-        }
-
-        double get(int phaser) const
-        {
-                return data[phaser].phase;
-        }
-
-        double get_radians(int phaser) const
-        {
-                return data[phaser].phase * TAU;
-        }
-
-        void advance()
-        {
-                for (auto& follower : followers) {
-                        data[follower.id].increment = data[follower.main].increment * follower.ratio;
-                }
-
-                for (auto& phaser : data) {
-                        phaser.phase =
-                                fmod(phaser.phase + phaser.increment, 1.0);
-                }
-        }
-
-private:
-        struct state {
-                double phase;
-                double increment;
-                state(double phase, double increment) :
-                        phase(phase),
-                        increment(increment) {}
-        };
-        std::vector<state> data;
-
-        struct follower_state {
-                size_t id;
-                size_t main;
-                double ratio;
-
-                follower_state(size_t id, size_t main, double ratio) :
-                        id(id),
-                        main(main),
-                        ratio(ratio) {}
-        };
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
-        std::vector<follower_state> followers;
-};
+#if defined(QNTRX_FIXED_PHASERS)
+/// the sequencing phasers accumulate exactly, for sessions of any length
+typedef FixedPhasers EnginePhasers;
+#else
+typedef Phasers EnginePhasers;
+#endif
 
 static double sinexpenv(double phase, double attack_speed, double decay_speed)
 {
@@ -97,7 +48,7 @@ static double sinexpenv(double phase, double attack_speed, double decay_speed)
         return attack * decay * fmin(1.0, 1000.0 * (1.0 - phase));
 }
 
-static void phaser_tweak(Phasers& phasers,
+static void phaser_tweak(EnginePhasers& phasers,
                          size_t const tweaked,
                          size_t const original,
                          size_t const shifter)
@@ -109,7 +60,7 @@ static void phaser_tweak(Phasers& phasers,
         phasers.change(tweaked, original);
 }
 
-static double phaser_fbmodulate(Phasers& phasers,
+static double phaser_fbmodulate(EnginePhasers& phasers,
                                 size_t const main,
                                 size_t const modulator,
                                 double const frequency,
@@ -134,123 +85,167 @@ static double phaser_n(double phase, double q)
         return fmod(q * phase, 1.0);
 }
 
-extern void render_next_2chn_48khz_audio(uint64_t time_micros,
-                int const sample_count, double left[/*sample_count*/],
-                double right[/*sample_count*/])
-{
-        static Phasers phasers;
-
-        static struct SharedPhasers {
-                size_t shifter = phasers.create(48000.0 / 64.0);
-                size_t measure = phasers.create(0.50);
-                size_t sometime = phasers.create_follower(measure, 1.0 / 16.0 / 8.0);
-        } shared_phasers;
-
-        static struct KickPhasers {
-                size_t a = phasers.create_follower(shared_phasers.measure, 4.0);
-                size_t aa = phasers.create_follower(a);
-                size_t osc = phasers.create(50.0);
-        } kick_phasers;
-
-        struct Kick {
-                double freq_env_base = 50.0;
-                double freq_env_amp = 1500.0;
-                double freq_env_accel = 1000.0;
-                double freq_env_decay = 80.0;
-                double amplitude_env_accel = 2000.0;
-                double amplitude_env_decay = 4.0;
-        } kick;
-
-        static struct BounceKickPhasers {
-                size_t osc = phasers.create_follower(kick_phasers.osc);
-        } bounce_kick_phasers;
-
-        struct BounceKick {
-                double freq_env_base = 50.0;
-                double amplitude_env_accel = 80.0;
-                double amplitude_env_decay = 20.0;
-        } bounce_kick;
-
-        static struct SnarePhasers {
-                size_t a = phasers.create_follower(kick_phasers.a, 1.0/2.0, 0.50);
-                size_t osc = phasers.create(180.0);
-                size_t mod_osc = phasers.create(90.0);
-        } snare_phasers;
-
-        struct Snare {
-                double freq_env_base = 50.0 * 1.5;
-                double freq_env_amp = 3000.0;
-                double freq_env_accel = 1000.0;
-                double freq_env_decay = 90.0;
-                double amplitude_env_accel = 1200.0;
-                double amplitude_env_decay = 13.0;
-                double modulator_freq_ratio = 1.0 / sqrt(1.5);
-                double modulator_index = 800.0;
-                double feedback = 1600.0;
-        } snare;
-
-
-        struct Hihat {
-                double freq_env_base = 50.0 * 4.0;
-                double freq_env_amp = 600.0;
-                double freq_env_accel = 1000.0;
-                double freq_env_decay = 90.0;
-                double amplitude_env_accel = 1200.0;
-                double amplitude_env_decay = 13.0;
-                double modulator_freq_ratio = 1.0 / sqrt(3.0);
-                double modulator_index = 800.0;
-                double feedback = 0.97;
-        } hihat;
-
-        static struct HihatPhasers {
-                size_t a = phasers.create_follower(kick_phasers.a, 1.0/2.0, 0.50);
-                size_t osc = phasers.create(180.0);
-                size_t mod_osc = phasers.create(90.0);
-        } hihat_phasers;
-
-        static struct BassPhasers {
-                size_t b = phasers.create(4.0);
-                size_t ba = phasers.create_follower(b);
-                size_t osc = phasers.create(110.0);
-                size_t sweep = phasers.create(1.0/32.0);
-                size_t modulator_osc = phasers.create(110.0);
-        } bass_phasers;
-
-        struct Bass {
-                double modulator_freq_ratio = 0.5;
-                double modulator_amp = 3.0;
-                double freq_env_base = 110.0;
-                double freq_env_amp = 1500.0;
-                double freq_env_accel = 400.0;
-                double freq_env_decay = 40.0;
-                double amplitude_env_accel = 8.0;
-                double amplitude_env_decay = 3.0;
-        } bass;
-
-        static struct MidPhasers {
-                size_t m = phasers.create(1.0/16.0, 0.750);
-                size_t root_osc = phasers.create(220.0);
-                size_t modulator_osc = phasers.create(220.0);
-                size_t detuned_osc = phasers.create_follower(root_osc, 1.0037);
-                size_t major[2];
-                size_t minor[2];
-
-                MidPhasers()
-                {
-                        major[0] = phasers.create_follower(root_osc, 5.0 / 4.0);
-                        minor[1] = phasers.create_follower(root_osc, 6.0 / 4.0);
-                        minor[0] = phasers.create_follower(root_osc, 12.0 / 10.0);
-                        minor[1] = phasers.create_follower(root_osc, 15.0 / 10.0);
-                }
-        } mid_phasers;
+static EnginePhasers phasers;
+
+static struct SharedPhasers {
+        size_t shifter = phasers.create(48000.0 / 64.0);
+        size_t measure = phasers.create(0.50);
+        size_t sometime = phasers.create_follower(measure, 1.0 / 16.0 / 8.0);
+} shared_phasers;
+
+static struct KickPhasers {
+        size_t a = phasers.create_follower(shared_phasers.measure, 4.0);
+        size_t aa = phasers.create_follower(a);
+        size_t osc = phasers.create(50.0);
+} kick_phasers;
+
+static struct BounceKickPhasers {
+        size_t osc = phasers.create_follower(kick_phasers.osc);
+} bounce_kick_phasers;
+
+static struct SnarePhasers {
+        size_t a = phasers.create_follower(kick_phasers.a, 1.0/2.0, 0.50);
+        size_t osc = phasers.create(180.0);
+        size_t mod_osc = phasers.create(90.0);
+} snare_phasers;
+
+static struct HihatPhasers {
+        size_t a = phasers.create_follower(kick_phasers.a, 1.0/2.0, 0.50);
+        size_t osc = phasers.create(180.0);
+        size_t mod_osc = phasers.create(90.0);
+} hihat_phasers;
+
+static struct BassPhasers {
+        size_t b = phasers.create(4.0);
+        size_t ba = phasers.create_follower(b);
+        size_t osc = phasers.create(110.0);
+        size_t sweep = phasers.create(1.0/32.0);
+        size_t modulator_osc = phasers.create(110.0);
+} bass_phasers;
+
+static struct MidPhasers {
+        size_t m = phasers.create(1.0/16.0, 0.750);
+        size_t root_osc = phasers.create(220.0);
+        size_t modulator_osc = phasers.create(220.0);
+        size_t detuned_osc = phasers.create_follower(root_osc, 1.0037);
+        size_t major[2];
+        size_t minor[2];
+
+        MidPhasers()
+        {
+                major[0] = phasers.create_follower(root_osc, 5.0 / 4.0);
+                minor[1] = phasers.create_follower(root_osc, 6.0 / 4.0);
+                minor[0] = phasers.create_follower(root_osc, 12.0 / 10.0);
+                minor[1] = phasers.create_follower(root_osc, 15.0 / 10.0);
+        }
+} mid_phasers;
+
+/**
+ * The parameters of the voices and their default values, each listed
+ * once as X(name, value).
+ *
+ * They define both a preset, whose parameters are constant expressions,
+ * and the runtime parameters, which start from them. Voices rendered
+ * with ConstantVoiceParams read the presets, which lets the compiler
+ * fold them into the voice code.
+ */
+#define KICK_PARAMETERS(X)                      \
+        X(freq_env_base, 50.0)                  \
+        X(freq_env_amp, 1500.0)                 \
+        X(freq_env_accel, 1000.0)               \
+        X(freq_env_decay, 80.0)                 \
+        X(amplitude_env_accel, 2000.0)          \
+        X(amplitude_env_decay, 4.0)
+
+#define BOUNCE_KICK_PARAMETERS(X)               \
+        X(freq_env_base, 50.0)                  \
+        X(amplitude_env_accel, 80.0)            \
+        X(amplitude_env_decay, 20.0)
+
+/* the ratios are 1.0 / sqrt(1.5) and 1.0 / sqrt(3.0), as sqrt is no constant expression */
+#define SNARE_PARAMETERS(X)                     \
+        X(freq_env_base, 50.0 * 1.5)            \
+        X(freq_env_amp, 3000.0)                 \
+        X(freq_env_accel, 1000.0)               \
+        X(freq_env_decay, 90.0)                 \
+        X(amplitude_env_accel, 1200.0)          \
+        X(amplitude_env_decay, 13.0)            \
+        X(modulator_freq_ratio, 0.8164965809277261) \
+        X(modulator_index, 800.0)               \
+        X(feedback, 1600.0)
+
+#define HIHAT_PARAMETERS(X)                     \
+        X(freq_env_base, 50.0 * 4.0)            \
+        X(freq_env_amp, 600.0)                  \
+        X(freq_env_accel, 1000.0)               \
+        X(freq_env_decay, 90.0)                 \
+        X(amplitude_env_accel, 1200.0)          \
+        X(amplitude_env_decay, 13.0)            \
+        X(modulator_freq_ratio, 0.5773502691896258) \
+        X(modulator_index, 800.0)               \
+        X(feedback, 0.97)
+
+#define MID_PARAMETERS(X)                       \
+        X(modulator_freq_ratio, 2.00)           \
+        X(modulator_amp, 15.0)                  \
+        X(modulator_fb, 0.2570)                 \
+        X(amplitude_env_accel, 5.0)             \
+        X(amplitude_env_decay, 6.0)
+
+#define PRESET_MEMBER(name, value) static constexpr double name = value;
+#define RUNTIME_MEMBER(name, value) double name = value;
+#define RAMP_MEMBER(name, value) ParamRamp name;
+#define RAMP_MEMBER_INIT(name, value) ramp.name = { from.name, (to.name - from.name) / n };
+
+/// with a Ramp struct for the blocks where they move, see RampedVoiceParams
+#define VOICE_PARAMS_STRUCTS(Runtime, Preset, Ramp, PARAMETERS)         \
+        struct Preset {                                                 \
+                PARAMETERS(PRESET_MEMBER)                               \
+        };                                                              \
+        struct Runtime {                                                \
+                PARAMETERS(RUNTIME_MEMBER)                              \
+        };                                                              \
+        struct Ramp {                                                   \
+                PARAMETERS(RAMP_MEMBER)                                 \
+        };                                                              \
+        static Ramp params_ramp(Runtime const& from, Runtime const& to, int const n) \
+        {                                                               \
+                Ramp ramp;                                              \
+                PARAMETERS(RAMP_MEMBER_INIT)                            \
+                return ramp;                                            \
+        }
 
-        struct Mid {
-                double modulator_freq_ratio = 2.00;
-                double modulator_amp = 15.0;
-                double modulator_fb = 0.2570;
-                double amplitude_env_accel = 5.0;
-                double amplitude_env_decay = 6.0;
-        } mid;
+VOICE_PARAMS_STRUCTS(Kick, KickPreset, KickRamp, KICK_PARAMETERS)
+VOICE_PARAMS_STRUCTS(BounceKick, BounceKickPreset, BounceKickRamp, BOUNCE_KICK_PARAMETERS)
+VOICE_PARAMS_STRUCTS(Snare, SnarePreset, SnareRamp, SNARE_PARAMETERS)
+VOICE_PARAMS_STRUCTS(Hihat, HihatPreset, HihatRamp, HIHAT_PARAMETERS)
+VOICE_PARAMS_STRUCTS(Mid, MidPreset, MidRamp, MID_PARAMETERS)
+
+#undef VOICE_PARAMS_STRUCTS
+#undef RAMP_MEMBER_INIT
+#undef RAMP_MEMBER
+#undef RUNTIME_MEMBER
+#undef PRESET_MEMBER
+
+struct Bass {
+        double modulator_freq_ratio = 0.5;
+        double modulator_amp = 3.0;
+        double freq_env_base = 110.0;
+        double freq_env_amp = 1500.0;
+        double freq_env_accel = 400.0;
+        double freq_env_decay = 40.0;
+        double amplitude_env_accel = 8.0;
+        double amplitude_env_decay = 3.0;
+};
+
+/// parameters of all voices, their tracks and the mix
+struct Patch {
+        Kick kick;
+        BounceKick bounce_kick;
+        Snare snare;
+        Hihat hihat;
+        Bass bass;
+        Mid mid;
 
         bool kick_track = true;
         bool bounce_kick_track = true;
@@ -258,27 +253,333 @@ extern void render_next_2chn_48khz_audio(uint64_t time_micros,
         bool hihat_track = true;
         bool mid_track = true;
 
-        double const kick_gain = 0.5;
-        double const kick_bounce_gain = 0.5;
-        double const snare_gain = 0.4;
-        double const hihat_gain = 0.5;
-        double const mid_gain = 0.25;
-        double const master_gain = 0.5;
+        double kick_gain = 0.5;
+        double kick_bounce_gain = 0.5;
+        double snare_gain = 0.4;
+        double hihat_gain = 0.5;
+        double mid_gain = 0.25;
+        double master_gain = 0.5;
+
+        /// sent to the reverb, the kick's send for both kicks
+        double kick_send = 0.05;
+        double snare_send = 0.3;
+        double hihat_send = 0.2;
+        double mid_send = 0.4;
+        /// of the reverb, into the mix
+        double reverb_return = 0.25;
+};
 
-        double const bpm = 133.0;
-        phasers.change(shared_phasers.measure, bpm / 120.0 * 0.50);
+/// the patch values which may be changed while playing, the voices' before the gains
+#define PATCH_PARAMETERS(X)                             \
+        X(KICK_FREQ_ENV_BASE, kick.freq_env_base)               \
+        X(KICK_FREQ_ENV_AMP, kick.freq_env_amp)                 \
+        X(KICK_FREQ_ENV_ACCEL, kick.freq_env_accel)             \
+        X(KICK_FREQ_ENV_DECAY, kick.freq_env_decay)             \
+        X(KICK_AMPLITUDE_ENV_ACCEL, kick.amplitude_env_accel)   \
+        X(KICK_AMPLITUDE_ENV_DECAY, kick.amplitude_env_decay)   \
+        X(BOUNCE_KICK_FREQ_ENV_BASE, bounce_kick.freq_env_base) \
+        X(BOUNCE_KICK_AMPLITUDE_ENV_ACCEL, bounce_kick.amplitude_env_accel) \
+        X(BOUNCE_KICK_AMPLITUDE_ENV_DECAY, bounce_kick.amplitude_env_decay) \
+        X(SNARE_FREQ_ENV_BASE, snare.freq_env_base)             \
+        X(SNARE_FREQ_ENV_AMP, snare.freq_env_amp)               \
+        X(SNARE_FREQ_ENV_ACCEL, snare.freq_env_accel)           \
+        X(SNARE_FREQ_ENV_DECAY, snare.freq_env_decay)           \
+        X(SNARE_AMPLITUDE_ENV_ACCEL, snare.amplitude_env_accel) \
+        X(SNARE_AMPLITUDE_ENV_DECAY, snare.amplitude_env_decay) \
+        X(SNARE_MODULATOR_FREQ_RATIO, snare.modulator_freq_ratio) \
+        X(SNARE_MODULATOR_INDEX, snare.modulator_index)         \
+        X(SNARE_FEEDBACK, snare.feedback)                       \
+        X(HIHAT_FREQ_ENV_BASE, hihat.freq_env_base)             \
+        X(HIHAT_FREQ_ENV_AMP, hihat.freq_env_amp)               \
+        X(HIHAT_FREQ_ENV_ACCEL, hihat.freq_env_accel)           \
+        X(HIHAT_FREQ_ENV_DECAY, hihat.freq_env_decay)           \
+        X(HIHAT_AMPLITUDE_ENV_ACCEL, hihat.amplitude_env_accel) \
+        X(HIHAT_AMPLITUDE_ENV_DECAY, hihat.amplitude_env_decay) \
+        X(HIHAT_MODULATOR_FREQ_RATIO, hihat.modulator_freq_ratio) \
+        X(HIHAT_MODULATOR_INDEX, hihat.modulator_index)         \
+        X(HIHAT_FEEDBACK, hihat.feedback)                       \
+        X(BASS_MODULATOR_FREQ_RATIO, bass.modulator_freq_ratio) \
+        X(BASS_MODULATOR_AMP, bass.modulator_amp)               \
+        X(BASS_FREQ_ENV_BASE, bass.freq_env_base)               \
+        X(BASS_FREQ_ENV_AMP, bass.freq_env_amp)                 \
+        X(BASS_FREQ_ENV_ACCEL, bass.freq_env_accel)             \
+        X(BASS_FREQ_ENV_DECAY, bass.freq_env_decay)             \
+        X(BASS_AMPLITUDE_ENV_ACCEL, bass.amplitude_env_accel)   \
+        X(BASS_AMPLITUDE_ENV_DECAY, bass.amplitude_env_decay)   \
+        X(MID_MODULATOR_FREQ_RATIO, mid.modulator_freq_ratio)   \
+        X(MID_MODULATOR_AMP, mid.modulator_amp)                 \
+        X(MID_MODULATOR_FB, mid.modulator_fb)                   \
+        X(MID_AMPLITUDE_ENV_ACCEL, mid.amplitude_env_accel)     \
+        X(MID_AMPLITUDE_ENV_DECAY, mid.amplitude_env_decay)     \
+        X(KICK_GAIN, kick_gain)                                 \
+        X(KICK_BOUNCE_GAIN, kick_bounce_gain)                   \
+        X(SNARE_GAIN, snare_gain)                               \
+        X(HIHAT_GAIN, hihat_gain)                               \
+        X(MID_GAIN, mid_gain)                                   \
+        X(MASTER_GAIN, master_gain)                             \
+        X(KICK_SEND, kick_send)                                 \
+        X(SNARE_SEND, snare_send)                               \
+        X(HIHAT_SEND, hihat_send)                               \
+        X(MID_SEND, mid_send)                                   \
+        X(REVERB_RETURN, reverb_return)
+
+/// the patch tracks, switched on when their value is not 0
+#define PATCH_SWITCHES(X)                               \
+        X(KICK_TRACK, kick_track)                       \
+        X(BOUNCE_KICK_TRACK, bounce_kick_track)         \
+        X(SNARE_TRACK, snare_track)                     \
+        X(HIHAT_TRACK, hihat_track)                     \
+        X(MID_TRACK, mid_track)
+
+#define PATCH_ENUM_ENTRY(name, member) PARAMETER_##name,
+
+enum Parameter {
+        PATCH_PARAMETERS(PATCH_ENUM_ENTRY)
+        PARAMETER_SMOOTHED_N,
+        PATCH_SWITCHES(PATCH_ENUM_ENTRY)
+        PARAMETER_N,
+};
+
+#undef PATCH_ENUM_ENTRY
+
+/// @returns the parameter named after its patch member, as in "kick.freq_env_base"
+static bool find_parameter(char const* name, Parameter* parameter)
+{
+#define PATCH_NAME_ENTRY(name, member) #member,
+        static char const* const names[] = {
+                PATCH_PARAMETERS(PATCH_NAME_ENTRY)
+                "",
+                PATCH_SWITCHES(PATCH_NAME_ENTRY)
+        };
+#undef PATCH_NAME_ENTRY
+        for (int i = 0; i < PARAMETER_N; i++) {
+                if (i != PARAMETER_SMOOTHED_N && 0 == strcmp(names[i], name)) {
+                        *parameter = Parameter(i);
+                        return true;
+                }
+        }
+        return false;
+}
+
+static double* patch_parameter(Patch& patch, Parameter const parameter)
+{
+#define PATCH_PARAMETER_CASE(name, member) \
+        case PARAMETER_##name: return &patch.member;
+        switch (parameter) {
+                PATCH_PARAMETERS(PATCH_PARAMETER_CASE)
+        default:
+                return nullptr;
+        }
+#undef PATCH_PARAMETER_CASE
+}
+
+static bool* patch_switch(Patch& patch, Parameter const parameter)
+{
+#define PATCH_SWITCH_CASE(name, member) \
+        case PARAMETER_##name: return &patch.member;
+        switch (parameter) {
+                PATCH_SWITCHES(PATCH_SWITCH_CASE)
+        default:
+                return nullptr;
+        }
+#undef PATCH_SWITCH_CASE
+}
+
+struct ParameterChange {
+        Parameter parameter;
+        double value;
+};
+
+/**
+ * Carries parameter changes from a single control thread (the render
+ * thread) to the audio thread, which applies them between blocks.
+ *
+ * Smoothed parameters ramp linearly to their new value over
+ * SMOOTHING_SECONDS, each with its own ramp, to avoid zipper noise.
+ * Switches apply at once.
+ *
+ * apply moves the ramps by a whole block. The parameters are then
+ * interpolated at every sample of the block, from their value at its
+ * start, see ParamRamp: the gains always, the voice parameters through
+ * RampedVoiceParams for the blocks where some of them move.
+ */
+static class PatchControl
+{
+public:
+        enum {
+                CHANNEL_CAPACITY = 256,
+        };
+
+        static constexpr double SMOOTHING_SECONDS = 0.020;
+
+        struct Ramp {
+                double target = 0.0;
+                int remaining_n = 0;
+        };
+
+        /// control thread side, @returns false when the channel is full
+        bool send(Parameter parameter, double value)
+        {
+                ParameterChange const change = { parameter, value };
+                return channel.push(change);
+        }
+
+        /// audio thread side, before rendering the next sample_count samples
+        void apply(Patch& patch, int const sample_count)
+        {
+                block_start = patch;
+                voice_params_ramping = false;
+                ParameterChange change;
+                while (channel.pop(&change)) {
+                        if (bool* const value = patch_switch(patch, change.parameter)) {
+                                *value = change.value != 0.0;
+                        } else if (patch_parameter(patch, change.parameter)) {
+                                auto& ramp = ramps[change.parameter];
+                                ramp.target = change.value;
+                                ramp.remaining_n = int(SMOOTHING_SECONDS * 48000.0);
+                        }
+                }
+
+                for (int i = 0; i < PARAMETER_SMOOTHED_N; i++) {
+                        auto& ramp = ramps[i];
+                        if (ramp.remaining_n <= 0) {
+                                continue;
+                        }
+                        double& value = *patch_parameter(patch, Parameter(i));
+                        voice_params_ramping = voice_params_ramping || i < PARAMETER_KICK_GAIN;
+                        if (sample_count >= ramp.remaining_n) {
+                                value = ramp.target;
+                                ramp.remaining_n = 0;
+                        } else {
+                                value += (ramp.target - value) * sample_count / ramp.remaining_n;
+                                ramp.remaining_n -= sample_count;
+                        }
+                }
+        }
+
+        /// audio thread side, the ramps in progress
+        void save_ramps(Ramp saved[/*PARAMETER_SMOOTHED_N*/]) const
+        {
+                std::copy_n(ramps, int(PARAMETER_SMOOTHED_N), saved);
+        }
+
+        void restore_ramps(Ramp const saved[/*PARAMETER_SMOOTHED_N*/])
+        {
+                std::copy_n(saved, int(PARAMETER_SMOOTHED_N), ramps);
+        }
+
+        /// the patch as it was before the last apply
+        Patch const& start() const
+        {
+                return block_start;
+        }
+
+        /// @returns true when the last apply moved some voice parameters, not only gains
+        bool ramps_voice_params() const
+        {
+                return voice_params_ramping;
+        }
+
+private:
+        SpscRing<ParameterChange, CHANNEL_CAPACITY> channel;
+        Ramp ramps[PARAMETER_SMOOTHED_N];
+        Patch block_start;
+        bool voice_params_ramping = false;
+} patch_control;
+
+constexpr double PatchControl::SMOOTHING_SECONDS;
+
+/**
+ * A parameter swept back and forth by the control thread, which sends
+ * its value through patch_control at every frame: the render thread
+ * at every render_next_gl3, or render_offline every
+ * SWEEP_FRAME_SAMPLE_N samples. For --sweep.
+ */
+static struct ParameterSweep {
+        enum {
+                /// a 60Hz frame, at 48kHz
+                SWEEP_FRAME_SAMPLE_N = 800,
+        };
+
+        Parameter parameter = PARAMETER_N;
+        double from = 0.0;
+        double to = 0.0;
+        double period_seconds = 1.0;
+
+        bool is_enabled() const
+        {
+                return parameter != PARAMETER_N;
+        }
+
+        /// control thread side, a change dropped when the channel is full is sent next frame
+        void send(double const seconds) const
+        {
+                if (!is_enabled()) {
+                        return;
+                }
+                // a triangle, at from at the start of every period and at to half way
+                double const t = fmod(seconds / period_seconds, 1.0);
+                double const position = t < 0.5 ? 2.0 * t : 2.0 - 2.0 * t;
+                patch_control.send(parameter, from + (to - from) * position);
+        }
+} parameter_sweep;
+
+/// @returns the ramp of gain over the block patch_control.apply moved patch by
+static ParamRamp gain_ramp(Patch const& patch, double Patch::* const gain, int const n)
+{
+        double const from = patch_control.start().*gain;
+        return { from, (patch.*gain - from) / n };
+}
+
+/// owned by the audio thread, changed through patch_control
+static Patch current_patch;
+
+enum RenderMode {
+        /// all voices for one sample, then the next sample
+        RENDER_SAMPLE_MAJOR,
+        /// one voice for a whole block, then the next voice
+        RENDER_VOICE_MAJOR,
+};
+
+static RenderMode render_mode = RENDER_VOICE_MAJOR;
+
+/// maximum difference between the outputs of both render modes
+static double const RENDER_MODES_TOLERANCE = 1e-12;
+
+static bool all_measures_but_last(double sometime_phase)
+{
+        return floor(fmod(1.0 + sometime_phase * 16.0, 16.0)) > 0.0;
+}
+
+static void render_sample_major(Patch const& patch,
+                                int const sample_count,
+                                double left[/*sample_count*/],
+                                double right[/*sample_count*/])
+{
+        auto const& kick = patch.kick;
+        auto const& bounce_kick = patch.bounce_kick;
+        auto const& snare = patch.snare;
+        auto const& hihat = patch.hihat;
+        auto const& mid = patch.mid;
+
+        bool const snare_track = patch.snare_track;
+        bool const hihat_track = patch.hihat_track;
+        bool const mid_track = patch.mid_track;
+
+        double const kick_gain = patch.kick_gain;
+        double const kick_bounce_gain = patch.kick_bounce_gain;
+        double const snare_gain = patch.snare_gain;
+        double const hihat_gain = patch.hihat_gain;
+        double const mid_gain = patch.mid_gain;
+        double const master_gain = patch.master_gain;
 
         for (int i = 0; i < sample_count; i++) {
                 left[i] = 0.0;
                 right[i] = 0.0;
 
-                bool all_measures_but_last =
-                        floor(fmod(1.0 +
-                                   phasers.get(shared_phasers.sometime) * 16.0,
-                                   16.0)) > 0.0;
-
-                kick_track = all_measures_but_last;
-                bounce_kick_track = kick_track;
+                bool const kick_track = patch.kick_track &&
+                                        all_measures_but_last(phasers.get(shared_phasers.sometime));
+                bool const bounce_kick_track = patch.bounce_kick_track && kick_track;
 
                 if (kick_track) {
                         auto const& note_phaser = kick_phasers.a;
@@ -465,16 +766,2478 @@ extern void render_next_2chn_48khz_audio(uint64_t time_micros,
         }
 }
 
-extern void render_next_gl3(uint64_t time_micros, struct Display)
+/// the synth's math as computed by libm, the reference
+struct ExactMath {
+        static double sin_turns(double turns)
+        {
+                return sin(turns * TAU);
+        }
+
+        static double cos_turns(double turns)
+        {
+                return cos(turns * TAU);
+        }
+
+        static double exp(double x)
+        {
+                return std::exp(x);
+        }
+
+        static void cos_turns_block(double const turns[], int n, double out[])
+        {
+                for (int i = 0; i < n; i++) {
+                        out[i] = cos(turns[i] * TAU);
+                }
+        }
+
+        static void sinexpenv_block(double const phases[], int n,
+                                    double attack_speed, double decay_speed,
+                                    double out[])
+        {
+                for (int i = 0; i < n; i++) {
+                        out[i] = sinexpenv(phases[i], attack_speed, decay_speed);
+                }
+        }
+};
+
+/// the synth's math using the polynomial kernels of fastmath.hpp
+struct FastMath {
+        static double sin_turns(double turns)
+        {
+                return fast_sin_turns(turns);
+        }
+
+        static double cos_turns(double turns)
+        {
+                return fast_cos_turns(turns);
+        }
+
+        static double exp(double x)
+        {
+                return fast_exp(x);
+        }
+
+        static void cos_turns_block(double const turns[], int n, double out[])
+        {
+                fast_cos_turns_block(turns, n, out);
+        }
+
+        static void sinexpenv_block(double const phases[], int n,
+                                    double attack_speed, double decay_speed,
+                                    double out[])
+        {
+                enum { CHUNK_N = 64 };
+                double const attack_dur = 1.0 / attack_speed;
+                double const decay_offset = decay_speed / attack_speed;
+                double attacks[CHUNK_N];
+                double decays[CHUNK_N];
+                for (int start = 0; start < n; start += CHUNK_N) {
+                        int const chunk_n = std::min<int>(CHUNK_N, n - start);
+                        double const* const chunk_phases = &phases[start];
+                        for (int i = 0; i < chunk_n; i++) {
+                                double const phase = chunk_phases[i];
+                                attacks[i] = fmin(attack_dur, phase) * attack_speed / 4.0;
+                                decays[i] = -decay_speed * phase + decay_offset;
+                        }
+                        fast_sin_turns_block(attacks, chunk_n, attacks);
+                        fast_exp_block(decays, chunk_n, decays);
+                        for (int i = 0; i < chunk_n; i++) {
+                                out[start + i] = fmax(0.0, attacks[i]) * fmin(1.0, decays[i]) *
+                                                 fmin(1.0, 1000.0 * (1.0 - chunk_phases[i]));
+                        }
+                }
+        }
+};
+
+enum MathMode {
+        /// libm, as render_sample_major
+        MATH_EXACT,
+        /**
+         * fastmath.hpp kernels, see there for their maximum errors.
+         *
+         * The feedback FM of the snare and hihat is chaotic, so the
+         * small errors grow and their waveforms drift away from
+         * MATH_EXACT's after a few seconds, while sounding the same.
+         */
+        MATH_FAST,
+};
+
+static MathMode math_mode = MATH_EXACT;
+
+enum EnvelopeMode {
+        /// sinexpenv evaluated at every sample
+        ENVELOPES_CLOSED_FORM,
+        /// sinexpenv advanced by recurrence, see SinExpEnvelope
+        ENVELOPES_INCREMENTAL,
+};
+
+static EnvelopeMode envelope_mode = ENVELOPES_CLOSED_FORM;
+
+enum {
+        BLOCK_SAMPLE_N = 256,
+        /// samples render_sample_major renders with the same patch
+        SAMPLE_MAJOR_CONTROL_N = 16,
+};
+
+/**
+ * The patterns played by the voice-major renderer.
+ *
+ * render_sample_major still works the same triggers out of beat
+ * arithmetic on every sample, and is the reference they reproduce.
+ */
+static struct Patterns {
+        /// gates the kicks, over the sometime phaser (8 measures a step)
+        Pattern arrangement;
+        /// over the measure phaser, a sixteenth note a step
+        Pattern bounce_kick;
+        Pattern hihat;
+
+        Patterns()
+        {
+                arrangement.parse("xxxxxxxxxxxxxxx.");
+                bounce_kick.parse("...x..x-........");
+                hihat.parse("..x...x...x...x.|.........x-.....");
+        }
+
+        Pattern* find(char const* name)
+        {
+                if (0 == strcmp(name, "arrangement")) {
+                        return &arrangement;
+                } else if (0 == strcmp(name, "bounce_kick")) {
+                        return &bounce_kick;
+                } else if (0 == strcmp(name, "hihat")) {
+                        return &hihat;
+                }
+                return nullptr;
+        }
+} patterns;
+
+/// one buffer per voice, for voice-major rendering
+static struct VoiceBuffers {
+        double kick[BLOCK_SAMPLE_N];
+        double kick_osc_increments[BLOCK_SAMPLE_N];
+        double bounce_kick[BLOCK_SAMPLE_N];
+        double snare[BLOCK_SAMPLE_N];
+        double hihat[BLOCK_SAMPLE_N];
+        double hihat_note_phases[BLOCK_SAMPLE_N];
+        double hihat_velocities[BLOCK_SAMPLE_N];
+        double mid_left[BLOCK_SAMPLE_N];
+        double mid_right[BLOCK_SAMPLE_N];
+} voice_buffers;
+
+/**
+ * The voices below render a block after phasers.advance_block, reading
+ * their clocks from the phasers' streams and integrating their own
+ * oscillators, exactly like phasers.advance() would have done.
+ *
+ * Envelopes and oscillator outputs are computed over the whole block
+ * by the Math policy; only the phase integration, which depends on
+ * the previous sample, runs one sample at a time.
+ *
+ * Without output buffers, a voice only integrates its oscillators, as
+ * when it sleeps: what it leaves in the phasers is the same to the bit.
+ */
+
+static void render_arrangement_gates(bool const track,
+                                     int const sample_count,
+                                     bool gates[/*sample_count*/])
+{
+        if (!track) {
+                std::fill_n(gates, sample_count, false);
+                return;
+        }
+        render_pattern(patterns.arrangement,
+                       phasers.stream(shared_phasers.sometime),
+                       phasers.get_increment(shared_phasers.sometime),
+                       sample_count, nullptr, nullptr, gates);
+}
+
+/**
+ * The phases the kick's amplitude follows, restarting on its notes
+ * only when the shifter is at 0.
+ *
+ * @returns the phase following the block's, for kick_phasers.aa
+ */
+static double render_kick_expression_phases(bool const gates[/*sample_count*/],
+                                            int const sample_count,
+                                            double expression_phases[/*sample_count*/])
 {
-        glClearColor (0.2f, 0.2f, 0.3f, 0.0f);
-        glClear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        auto const& voice = kick_phasers;
+        double const* const note_phases = phasers.stream(voice.a);
+        double const* const shifter_phases = phasers.stream(shared_phasers.shifter);
+
+        double expression_phase = phasers.stream(voice.aa)[0];
+        double const expression_increment = phasers.get_increment(voice.aa);
+        for (int i = 0; i < sample_count; i++) {
+                if (gates[i] && shifter_phases[i] == 0.0) {
+                        expression_phase = note_phases[i];
+                }
+                expression_phases[i] = expression_phase;
+                expression_phase = phaser_wrap(expression_phase + expression_increment);
+        }
+        return expression_phase;
 }
 
-int main (int argc, char** argv)
+template <typename Math, typename Params>
+static void render_kick_block(Params const& params,
+                              bool const track,
+                              ParamRamp const gain,
+                              int const sample_count,
+                              int const control_period,
+                              double out[/*sample_count, optional*/],
+                              double osc_increments[/*sample_count*/])
+{
+        auto const& voice = kick_phasers;
+        double const* const note_phases = phasers.stream(voice.a);
+
+        bool gates[BLOCK_SAMPLE_N];
+        render_arrangement_gates(track, sample_count, gates);
+
+        // zeroed, as GCC can not tell that the envelopes only read sample_count phases
+        double expression_phases[BLOCK_SAMPLE_N] = {};
+        phasers.offset(voice.aa,
+                       render_kick_expression_phases(gates, sample_count, expression_phases));
+
+        double frequencies[BLOCK_SAMPLE_N];
+        swept_frequency_stage<Math>(params, note_phases, sample_count, control_period,
+                                    frequencies);
+
+        double oscs[BLOCK_SAMPLE_N];
+        OscillatorState osc = {
+                phasers.stream(voice.osc)[0], phasers.get_increment(voice.osc),
+        };
+        gated_oscillator_stage(frequencies, gates, sample_count, osc, oscs, osc_increments);
+        phasers.offset(voice.osc, osc.phase);
+        phasers.increment(voice.osc, osc.increment);
+        if (!out) {
+                return;
+        }
+        Math::cos_turns_block(oscs, sample_count, oscs);
+
+        double amplitudes[BLOCK_SAMPLE_N];
+        amplitude_envelope_stage<Math>(params, expression_phases, sample_count, control_period,
+                                       amplitudes);
+        for (int i = 0; i < sample_count; i++) {
+                out[i] = gates[i] ? gain.at(i) * amplitudes[i] * oscs[i] : 0.0;
+        }
+}
+
+template <typename Math, typename Params>
+static void render_bounce_kick_block(Params const& params,
+                                     bool const track,
+                                     ParamRamp const gain,
+                                     int const sample_count,
+                                     int const control_period,
+                                     double const kick_osc_increments[/*sample_count*/],
+                                     double out[/*sample_count, optional*/])
+{
+        auto const& voice = bounce_kick_phasers;
+
+        double ratio = 1.0;
+        bool const follows_kick = phasers.follows(voice.osc, kick_phasers.osc, &ratio);
+        assert(follows_kick);
+        (void) follows_kick;
+
+        double oscs[BLOCK_SAMPLE_N];
+        double osc_phase = phasers.stream(voice.osc)[0];
+        follower_oscillator_stage(kick_osc_increments, ratio, sample_count, osc_phase, oscs);
+        phasers.offset(voice.osc, osc_phase);
+        if (!out) {
+                return;
+        }
+        Math::cos_turns_block(oscs, sample_count, oscs);
+
+        bool gates[BLOCK_SAMPLE_N];
+        render_arrangement_gates(track, sample_count, gates);
+
+        double note_phases[BLOCK_SAMPLE_N];
+        double velocities[BLOCK_SAMPLE_N];
+        render_pattern(patterns.bounce_kick,
+                       phasers.stream(shared_phasers.measure),
+                       phasers.get_increment(shared_phasers.measure),
+                       sample_count, note_phases, velocities, nullptr);
+
+        double amplitudes[BLOCK_SAMPLE_N];
+        amplitude_envelope_stage<Math>(params, note_phases, sample_count, control_period,
+                                       amplitudes);
+        for (int i = 0; i < sample_count; i++) {
+                out[i] = gates[i] ? gain.at(i) * amplitudes[i] * oscs[i] * velocities[i] : 0.0;
+        }
+}
+
+/// a FM percussion with a feedback modulator, as used by snare and hihat
+template <typename Math, typename Params, typename VoicePhasers>
+static void render_fm_drum_block(Params const& params,
+                                 VoicePhasers const& voice,
+                                 ParamRamp const gain,
+                                 int const sample_count,
+                                 int const control_period,
+                                 double const note_phases[/*sample_count*/],
+                                 double const velocities[/*sample_count, optional*/],
+                                 double out[/*sample_count, optional*/])
+{
+        double frequencies[BLOCK_SAMPLE_N];
+        swept_frequency_stage<Math>(params, note_phases, sample_count, control_period,
+                                    frequencies);
+
+        double oscs[BLOCK_SAMPLE_N];
+        double osc_sines[BLOCK_SAMPLE_N];
+        OscillatorState osc = {
+                phasers.stream(voice.osc)[0], phasers.get_increment(voice.osc),
+        };
+        OscillatorState modulator = {
+                phasers.stream(voice.mod_osc)[0], phasers.get_increment(voice.mod_osc),
+        };
+        feedback_fm_stage<Math>(params, frequencies, sample_count, osc, modulator,
+                                oscs, osc_sines);
+        phasers.offset(voice.osc, osc.phase);
+        phasers.increment(voice.osc, osc.increment);
+        phasers.offset(voice.mod_osc, modulator.phase);
+        phasers.increment(voice.mod_osc, modulator.increment);
+        if (!out) {
+                return;
+        }
+        Math::cos_turns_block(oscs, sample_count, oscs);
+
+        double amplitudes[BLOCK_SAMPLE_N];
+        amplitude_envelope_stage<Math>(params, note_phases, sample_count, control_period,
+                                       amplitudes);
+        for (int i = 0; i < sample_count; i++) {
+                out[i] = gain.at(i) * amplitudes[i] * oscs[i] * osc_sines[i];
+        }
+        if (velocities) {
+                for (int i = 0; i < sample_count; i++) {
+                        out[i] *= velocities[i];
+                }
+        }
+}
+
+template <typename Math, typename Params>
+static void render_mid_block(Params const& params,
+                             ParamRamp const mid_gain,
+                             int const sample_count,
+                             int const control_period,
+                             double left[/*sample_count, optional*/],
+                             double right[/*sample_count, optional*/])
 {
-        (void) argc;
-        (void) argv;
+        auto const& voice = mid_phasers;
+        double const* const note_phases = phasers.stream(voice.m);
+
+        double amplitudes[BLOCK_SAMPLE_N];
+        amplitude_envelope_stage<Math>(params, note_phases, sample_count, control_period,
+                                       amplitudes);
+
+        // only one of the chords sounds in a block
+        double silence;
+        {
+                double const rest_phase = 0.0;
+                envelope_block<Math>(&rest_phase, 1,
+                                     params.amplitude_env_accel,
+                                     params.amplitude_env_decay,
+                                     1, &silence);
+        }
+        double const section = fmod(floor(shared_phasers.sometime * 16.0 * 4.0), 2.0);
+        bool const minor_section = section == 0.0;
+        bool const major_section = section == 1.0;
+
+        /// oscillators following the root, or read from their stream
+        struct Partial {
+                size_t id;
+                bool follows_root;
+                double ratio;
+                double phase;
+                double oscs[BLOCK_SAMPLE_N];
+        };
+        Partial detuned, major[2], minor[2];
+        Partial* const partials[] = {
+                &major[0], &major[1], &minor[0], &minor[1], &detuned,
+        };
+        {
+                size_t const ids[] = {
+                        voice.major[0], voice.major[1], voice.minor[0], voice.minor[1],
+                        voice.detuned_osc,
+                };
+                for (size_t i = 0; i < sizeof ids / sizeof ids[0]; i++) {
+                        auto& partial = *partials[i];
+                        partial.id = ids[i];
+                        partial.ratio = 1.0;
+                        partial.follows_root = phasers.follows(ids[i], voice.root_osc,
+                                                               &partial.ratio);
+                        partial.phase = phasers.stream(ids[i])[0];
+                }
+        }
+
+        double root_oscs[BLOCK_SAMPLE_N];
+        {
+                double root_phase = phasers.stream(voice.root_osc)[0];
+                double root_increment = phasers.get_increment(voice.root_osc);
+                double mod_phase = phasers.stream(voice.modulator_osc)[0];
+                double mod_increment = phasers.get_increment(voice.modulator_osc);
+
+                for (int i = 0; i < sample_count; i++) {
+                        double const frequency = 50.0 * 5;
+                        double const modulation = amplitudes[i] *
+                                                  param_at(params.modulator_amp, i) *
+                                                  Math::sin_turns(mod_phase);
+                        double const main_freq = frequency + modulation;
+
+                        mod_increment = Phasers::to_increment(param_at(params.modulator_fb, i) *
+                                                              Math::sin_turns(root_phase) +
+                                                              frequency /
+                                                              param_at(params.modulator_freq_ratio, i));
+                        root_increment = Phasers::to_increment(main_freq);
+
+                        root_oscs[i] = root_phase;
+                        for (auto partial : partials) {
+                                if (partial->follows_root) {
+                                        partial->oscs[i] = partial->phase;
+                                        partial->phase = phaser_wrap(partial->phase +
+                                                                     phaser_wrap_increment(root_increment * partial->ratio));
+                                }
+                        }
+
+                        root_phase = phaser_wrap(root_phase + root_increment);
+                        mod_phase = phaser_wrap(mod_phase + mod_increment);
+                }
+
+                phasers.offset(voice.root_osc, root_phase);
+                phasers.increment(voice.root_osc, root_increment);
+                phasers.offset(voice.modulator_osc, mod_phase);
+                phasers.increment(voice.modulator_osc, mod_increment);
+        }
+        for (auto partial : partials) {
+                if (partial->follows_root) {
+                        phasers.offset(partial->id, partial->phase);
+                }
+        }
+        if (!left) {
+                return;
+        }
+
+        Math::cos_turns_block(root_oscs, sample_count, root_oscs);
+        for (auto partial : partials) {
+                if (partial->follows_root) {
+                        Math::cos_turns_block(partial->oscs, sample_count, partial->oscs);
+                } else {
+                        Math::cos_turns_block(phasers.stream(partial->id), sample_count,
+                                              partial->oscs);
+                }
+        }
+
+        for (int i = 0; i < sample_count; i++) {
+                left[i] = 0.0;
+                right[i] = 0.0;
+
+                double const gain = mid_gain.at(i);
+                double const major_amplitude = major_section ? amplitudes[i] : silence;
+                for (auto const& partial : major) {
+                        double const osc = major_amplitude * partial.oscs[i];
+
+                        left[i] += gain * osc;
+                        right[i] += gain * osc;
+                }
+
+                double const minor_amplitude = minor_section ? amplitudes[i] : silence;
+                for (auto const& partial : minor) {
+                        double const osc = minor_amplitude * partial.oscs[i];
+
+                        left[i] += gain * osc;
+                        right[i] += gain * osc;
+                }
+
+                double const osc = amplitudes[i] * root_oscs[i];
+
+                double const detuned_osc = amplitudes[i] * detuned.oscs[i];
+
+                left[i] += gain * (0.55 * osc + 0.45 * detuned_osc);
+                right[i] += gain * (0.45 * osc + 0.55 * detuned_osc);
+        }
+}
+
+enum Voice {
+        VOICE_KICK,
+        VOICE_BOUNCE_KICK,
+        VOICE_SNARE,
+        VOICE_HIHAT,
+        VOICE_MID,
+        VOICE_N,
+};
+
+static char const* const VOICE_NAMES[VOICE_N] = {
+        "kick", "bounce-kick", "snare", "hihat", "mid",
+};
+
+/// @returns false when no voice is named name
+static bool find_voice(char const* name, Voice* voice)
+{
+        for (int v = 0; v < VOICE_N; v++) {
+                if (0 == strcmp(VOICE_NAMES[v], name)) {
+                        *voice = Voice(v);
+                        return true;
+                }
+        }
+        return false;
+}
+
+enum {
+        /// longest interval between two evaluations of an envelope
+        MAX_CONTROL_PERIOD = BLOCK_SAMPLE_N,
+};
+
+/**
+ * Samples between two evaluations of each voice's envelopes, which
+ * are interpolated in between. 1 evaluates them at every sample, as
+ * render_sample_major does.
+ */
+static struct ControlRates {
+        int periods[VOICE_N] = { 1, 1, 1, 1, 1 };
+
+        void set_all(int const period)
+        {
+                std::fill_n(periods, int(VOICE_N), period);
+        }
+} control_rates;
+
+/// @returns the phasers the voice integrates itself, in ids[]
+static size_t voice_phasers(Voice const voice, size_t ids[/*8*/])
+{
+        size_t n = 0;
+        switch (voice) {
+        case VOICE_KICK:
+                ids[n++] = kick_phasers.aa;
+                ids[n++] = kick_phasers.osc;
+                break;
+        case VOICE_BOUNCE_KICK:
+                ids[n++] = bounce_kick_phasers.osc;
+                break;
+        case VOICE_SNARE:
+                ids[n++] = snare_phasers.osc;
+                ids[n++] = snare_phasers.mod_osc;
+                break;
+        case VOICE_HIHAT:
+                ids[n++] = hihat_phasers.osc;
+                ids[n++] = hihat_phasers.mod_osc;
+                break;
+        case VOICE_MID: {
+                auto const& voice = mid_phasers;
+                ids[n++] = voice.root_osc;
+                ids[n++] = voice.modulator_osc;
+                size_t const partials[] = {
+                        voice.detuned_osc, voice.major[0], voice.major[1],
+                        voice.minor[0], voice.minor[1],
+                };
+                double ratio;
+                for (auto id : partials) {
+                        if (phasers.follows(id, voice.root_osc, &ratio)) {
+                                ids[n++] = id;
+                        }
+                }
+                break;
+        }
+        case VOICE_N:
+                break;
+        }
+        return n;
+}
+
+/// @returns the buffers the voice outputs to, in outs[]
+static int voice_outputs(Voice const voice, VoiceBuffers& buffers, double* outs[/*2*/])
+{
+        switch (voice) {
+        case VOICE_KICK:
+                outs[0] = buffers.kick;
+                return 1;
+        case VOICE_BOUNCE_KICK:
+                outs[0] = buffers.bounce_kick;
+                return 1;
+        case VOICE_SNARE:
+                outs[0] = buffers.snare;
+                return 1;
+        case VOICE_HIHAT:
+                outs[0] = buffers.hihat;
+                return 1;
+        case VOICE_MID:
+                outs[0] = buffers.mid_left;
+                outs[1] = buffers.mid_right;
+                return 2;
+        case VOICE_N:
+                break;
+        }
+        return 0;
+}
+
+/**
+ * Voices which may render concurrently, each group rendering its
+ * voices in order.
+ *
+ * A voice integrating a phaser which follows a phaser integrated by
+ * another voice must render after it, within the same group. Clocks
+ * are advanced before any voice renders, so following them creates no
+ * dependency.
+ */
+static struct VoiceGroups {
+        Voice voices[VOICE_N];
+        int starts[VOICE_N + 1];
+        int group_n = 0;
+
+        VoiceGroups()
+        {
+                int group_of[VOICE_N];
+                for (int v = 0; v < VOICE_N; v++) {
+                        group_of[v] = v;
+                }
+
+                size_t ids[VOICE_N][8];
+                size_t id_n[VOICE_N];
+                for (int v = 0; v < VOICE_N; v++) {
+                        id_n[v] = voice_phasers(Voice(v), ids[v]);
+                }
+
+                // later voices join the group of the voice they depend on
+                double ratio;
+                for (int v = 0; v < VOICE_N; v++) {
+                        for (int main_v = 0; main_v < v; main_v++) {
+                                for (size_t i = 0; i < id_n[v]; i++) {
+                                        for (size_t j = 0; j < id_n[main_v]; j++) {
+                                                if (phasers.follows(ids[v][i], ids[main_v][j],
+                                                                    &ratio)) {
+                                                        assert(group_of[v] == v ||
+                                                               group_of[v] == group_of[main_v]);
+                                                        group_of[v] = group_of[main_v];
+                                                }
+                                        }
+                                }
+                        }
+                }
+
+                int n = 0;
+                for (int g = 0; g < VOICE_N; g++) {
+                        int const start = n;
+                        for (int v = 0; v < VOICE_N; v++) {
+                                if (group_of[v] == g) {
+                                        voices[n++] = Voice(v);
+                                }
+                        }
+                        if (n != start) {
+                                starts[group_n++] = start;
+                        }
+                }
+                starts[group_n] = n;
+        }
+} voice_groups;
+
+/**
+ * Voices read their parameters from the patch, as changed live, for
+ * the blocks of n samples where they stay the same.
+ */
+struct RuntimeVoiceParams {
+        static Kick const& kick(Patch const& patch, int)
+        {
+                return patch.kick;
+        }
+        static BounceKick const& bounce_kick(Patch const& patch, int)
+        {
+                return patch.bounce_kick;
+        }
+        static Snare const& snare(Patch const& patch, int)
+        {
+                return patch.snare;
+        }
+        static Hihat const& hihat(Patch const& patch, int)
+        {
+                return patch.hihat;
+        }
+        static Mid const& mid(Patch const& patch, int)
+        {
+                return patch.mid;
+        }
+};
+
+/**
+ * Voices read their parameters as ramps over the block of n samples,
+ * from where patch_control.apply moved the patch from, like the gains.
+ */
+struct RampedVoiceParams {
+        static KickRamp kick(Patch const& patch, int const n)
+        {
+                return params_ramp(patch_control.start().kick, patch.kick, n);
+        }
+        static BounceKickRamp bounce_kick(Patch const& patch, int const n)
+        {
+                return params_ramp(patch_control.start().bounce_kick, patch.bounce_kick, n);
+        }
+        static SnareRamp snare(Patch const& patch, int const n)
+        {
+                return params_ramp(patch_control.start().snare, patch.snare, n);
+        }
+        static HihatRamp hihat(Patch const& patch, int const n)
+        {
+                return params_ramp(patch_control.start().hihat, patch.hihat, n);
+        }
+        static MidRamp mid(Patch const& patch, int const n)
+        {
+                return params_ramp(patch_control.start().mid, patch.mid, n);
+        }
+};
+
+/**
+ * Voices are compiled with their presets' constant parameters.
+ *
+ * Tracks and gains still come from the patch, but changes to the
+ * other voice parameters are ignored.
+ */
+struct ConstantVoiceParams {
+        static KickPreset kick(Patch const&, int)
+        {
+                return KickPreset();
+        }
+        static BounceKickPreset bounce_kick(Patch const&, int)
+        {
+                return BounceKickPreset();
+        }
+        static SnarePreset snare(Patch const&, int)
+        {
+                return SnarePreset();
+        }
+        static HihatPreset hihat(Patch const&, int)
+        {
+                return HihatPreset();
+        }
+        static MidPreset mid(Patch const&, int)
+        {
+                return MidPreset();
+        }
+};
+
+enum VoiceParamsMode {
+        /// RuntimeVoiceParams, or RampedVoiceParams while they move
+        VOICE_PARAMS_RUNTIME,
+        /// ConstantVoiceParams
+        VOICE_PARAMS_CONSTANT,
+};
+
+static VoiceParamsMode voice_params_mode = VOICE_PARAMS_RUNTIME;
+
+/// time spent rendering each voice, when enabled
+static struct VoiceTimes {
+        bool enabled = false;
+        double seconds[VOICE_N] = {};
+} voice_times;
+
+/**
+ * A voice whose output stays under threshold over a block sleeps
+ * through it: its buffers are cleared rather than rendered. It wakes
+ * at the block where its envelope rises again, at its next note.
+ *
+ * A sleeping voice still integrates its oscillators, as their
+ * increments depend on their own phases, but skips its envelopes,
+ * waveforms and output. It wakes up in the state it would have had
+ * awake, so the output only differs by what was under threshold, see
+ * voice_sleep_check. Voices never sleep unless a threshold is set.
+ */
+static struct VoiceSleep {
+        /// output level under which a voice sleeps, 0 to never sleep
+        double threshold = 0.0;
+        uint64_t block_n[VOICE_N] = {};
+        uint64_t asleep_block_n[VOICE_N] = {};
+} voice_sleep;
+
+/**
+ * @returns the highest value of the envelope over note_phases
+ *
+ * The envelope rises until the end of its attack then only decays. A
+ * phase of 0 is where no note sounds, or where one starts at 0.
+ */
+static double envelope_bound(double const note_phases[/*n*/],
+                             int const n,
+                             double const attack_speed,
+                             double const decay_speed)
+{
+        double min_phase = 1.0;
+        for (int i = 0; i < n; i++) {
+                if (note_phases[i] > 0.0 && note_phases[i] < min_phase) {
+                        min_phase = note_phases[i];
+                }
+        }
+        if (min_phase < 1.0 / attack_speed) {
+                return 1.0;
+        }
+        return sinexpenv(min_phase, attack_speed, decay_speed);
+}
+
+/**
+ * @returns the highest value of the envelope over note_phases, while
+ * its parameters ramp
+ *
+ * Past its attack, the envelope is highest with the lowest speeds,
+ * whose attack is also the longest, taken as a whole to be 1.
+ */
+static double envelope_bound(double const note_phases[/*n*/],
+                             int const n,
+                             ParamRamp const attack_speed,
+                             ParamRamp const decay_speed)
+{
+        return envelope_bound(note_phases, n,
+                              std::min(attack_speed.at(0), attack_speed.at(n - 1)),
+                              std::min(decay_speed.at(0), decay_speed.at(n - 1)));
+}
+
+/**
+ * @returns the highest level the voice may output over the block,
+ * without rendering it
+ *
+ * The hihat's notes must have been rendered into voice_buffers.
+ */
+template <typename VoiceParams>
+static double voice_level_bound(Voice const voice,
+                                Patch const& patch,
+                                int const sample_count)
+{
+        auto const& buffers = voice_buffers;
+        switch (voice) {
+        case VOICE_KICK: {
+                bool gates[BLOCK_SAMPLE_N];
+                render_arrangement_gates(patch.kick_track, sample_count, gates);
+                if (std::count(gates, gates + sample_count, true) == 0) {
+                        return 0.0;
+                }
+                double expression_phases[BLOCK_SAMPLE_N];
+                render_kick_expression_phases(gates, sample_count, expression_phases);
+                auto const& params = VoiceParams::kick(patch, sample_count);
+                return gain_ramp(patch, &Patch::kick_gain, sample_count).bound(sample_count) *
+                       envelope_bound(expression_phases, sample_count,
+                                      params.amplitude_env_accel, params.amplitude_env_decay);
+        }
+
+        case VOICE_BOUNCE_KICK: {
+                bool gates[BLOCK_SAMPLE_N];
+                render_arrangement_gates(patch.kick_track && patch.bounce_kick_track,
+                                         sample_count, gates);
+                if (std::count(gates, gates + sample_count, true) == 0) {
+                        return 0.0;
+                }
+                double note_phases[BLOCK_SAMPLE_N];
+                double velocities[BLOCK_SAMPLE_N];
+                render_pattern(patterns.bounce_kick,
+                               phasers.stream(shared_phasers.measure),
+                               phasers.get_increment(shared_phasers.measure),
+                               sample_count, note_phases, velocities, nullptr);
+                auto const& params = VoiceParams::bounce_kick(patch, sample_count);
+                return gain_ramp(patch, &Patch::kick_bounce_gain, sample_count).bound(sample_count) *
+                       *std::max_element(velocities, velocities + sample_count) *
+                       envelope_bound(note_phases, sample_count,
+                                      params.amplitude_env_accel, params.amplitude_env_decay);
+        }
+
+        case VOICE_SNARE: {
+                if (!patch.snare_track) {
+                        return 0.0;
+                }
+                auto const& params = VoiceParams::snare(patch, sample_count);
+                return gain_ramp(patch, &Patch::snare_gain, sample_count).bound(sample_count) *
+                       envelope_bound(phasers.stream(snare_phasers.a), sample_count,
+                                      params.amplitude_env_accel, params.amplitude_env_decay);
+        }
+
+        case VOICE_HIHAT: {
+                if (!patch.hihat_track) {
+                        return 0.0;
+                }
+                auto const& params = VoiceParams::hihat(patch, sample_count);
+                double const* const velocities = buffers.hihat_velocities;
+                return gain_ramp(patch, &Patch::hihat_gain, sample_count).bound(sample_count) *
+                       *std::max_element(velocities, velocities + sample_count) *
+                       envelope_bound(buffers.hihat_note_phases, sample_count,
+                                      params.amplitude_env_accel, params.amplitude_env_decay);
+        }
+
+        case VOICE_MID: {
+                if (!patch.mid_track) {
+                        return 0.0;
+                }
+                auto const& params = VoiceParams::mid(patch, sample_count);
+                // two partials of a chord, the root and its detuned copy
+                return 3.0 * gain_ramp(patch, &Patch::mid_gain, sample_count).bound(sample_count) *
+                       envelope_bound(phasers.stream(mid_phasers.m), sample_count,
+                                      params.amplitude_env_accel, params.amplitude_env_decay);
+        }
+
+        case VOICE_N:
+                break;
+        }
+        return HUGE_VAL;
+}
+
+/**
+ * Renders the voice into its buffers, or when asleep clears them and
+ * only integrates its oscillators.
+ */
+template <typename Math, typename VoiceParams>
+static void render_voice_buffers(Voice const voice,
+                                 Patch const& patch,
+                                 int const sample_count,
+                                 bool const asleep)
+{
+        auto& buffers = voice_buffers;
+        int const control_period = control_rates.periods[voice];
+
+        switch (voice) {
+        case VOICE_KICK:
+                render_kick_block<Math>(VoiceParams::kick(patch, sample_count), patch.kick_track,
+                                        gain_ramp(patch, &Patch::kick_gain, sample_count),
+                                        sample_count, control_period,
+                                        asleep ? nullptr : buffers.kick,
+                                        buffers.kick_osc_increments);
+                break;
+
+        case VOICE_BOUNCE_KICK:
+                render_bounce_kick_block<Math>(VoiceParams::bounce_kick(patch, sample_count),
+                                               patch.kick_track && patch.bounce_kick_track,
+                                               gain_ramp(patch, &Patch::kick_bounce_gain,
+                                                         sample_count),
+                                               sample_count, control_period,
+                                               buffers.kick_osc_increments,
+                                               asleep ? nullptr : buffers.bounce_kick);
+                break;
+
+        case VOICE_SNARE:
+                if (patch.snare_track) {
+                        render_fm_drum_block<Math>(VoiceParams::snare(patch, sample_count), snare_phasers,
+                                                   gain_ramp(patch, &Patch::snare_gain, sample_count),
+                                                   sample_count, control_period,
+                                                   phasers.stream(snare_phasers.a),
+                                                   nullptr, asleep ? nullptr : buffers.snare);
+                } else {
+                        std::fill_n(buffers.snare, sample_count, 0.0);
+                }
+                break;
+
+        case VOICE_HIHAT:
+                if (patch.hihat_track) {
+                        render_fm_drum_block<Math>(VoiceParams::hihat(patch, sample_count), hihat_phasers,
+                                                   gain_ramp(patch, &Patch::hihat_gain, sample_count),
+                                                   sample_count, control_period,
+                                                   buffers.hihat_note_phases,
+                                                   buffers.hihat_velocities,
+                                                   asleep ? nullptr : buffers.hihat);
+                } else {
+                        std::fill_n(buffers.hihat, sample_count, 0.0);
+                }
+                break;
+
+        case VOICE_MID:
+                if (patch.mid_track) {
+                        render_mid_block<Math>(VoiceParams::mid(patch, sample_count),
+                                               gain_ramp(patch, &Patch::mid_gain, sample_count),
+                                               sample_count,
+                                               control_period,
+                                               asleep ? nullptr : buffers.mid_left,
+                                               asleep ? nullptr : buffers.mid_right);
+                } else {
+                        std::fill_n(buffers.mid_left, sample_count, 0.0);
+                        std::fill_n(buffers.mid_right, sample_count, 0.0);
+                }
+                break;
+
+        case VOICE_N:
+                break;
+        }
+
+        if (asleep) {
+                double* outs[2];
+                for (int i = 0, n = voice_outputs(voice, buffers, outs); i < n; i++) {
+                        std::fill_n(outs[i], sample_count, 0.0);
+                }
+        }
+}
+
+/// renders the notes of the voices which play them from a pattern
+static void render_voice_notes(Voice const voice,
+                               Patch const& patch,
+                               int const sample_count)
+{
+        auto& buffers = voice_buffers;
+        if (voice == VOICE_HIHAT && patch.hihat_track) {
+                render_pattern(patterns.hihat,
+                               phasers.stream(shared_phasers.measure),
+                               phasers.get_increment(shared_phasers.measure),
+                               sample_count, buffers.hihat_note_phases,
+                               buffers.hihat_velocities, nullptr);
+        }
+}
+
+template <typename Math, typename VoiceParams>
+static void render_voice(Voice const voice,
+                         Patch const& patch,
+                         int const sample_count)
+{
+        using std::chrono::steady_clock;
+        bool const timed = voice_times.enabled;
+        auto const start = timed ? steady_clock::now() : steady_clock::time_point();
+
+        render_voice_notes(voice, patch, sample_count);
+
+        bool asleep = false;
+        if (voice_sleep.threshold > 0.0) {
+                asleep = voice_level_bound<VoiceParams>(voice, patch, sample_count) <=
+                         voice_sleep.threshold;
+                voice_sleep.block_n[voice]++;
+                voice_sleep.asleep_block_n[voice] += asleep;
+        }
+        render_voice_buffers<Math, VoiceParams>(voice, patch, sample_count, asleep);
+
+        if (timed) {
+                voice_times.seconds[voice] +=
+                        std::chrono::duration<double>(steady_clock::now() - start).count();
+        }
+}
+
+/// renders voices on these in addition to the audio thread, when started
+static Workers voice_workers;
+
+/**
+ * Starts up to requested_n voice_workers, no more than there are voice
+ * groups and cores besides the audio thread's: a worker without a core
+ * of its own only delays the others.
+ */
+static void start_voice_workers(int const requested_n)
+{
+        int const core_n = std::max(1, int(std::thread::hardware_concurrency()));
+        voice_workers.start(std::max(0, std::min(std::min(requested_n, voice_groups.group_n - 1),
+                                                 core_n - 1)));
+}
+
+/// the send bus of the voice-major renders, once loaded
+static ConvolutionReverb reverb;
+
+/// the reverb's send and return, kept out of the audio thread's stack
+static struct ReverbBuffers {
+        double send[BLOCK_SAMPLE_N];
+        double left[BLOCK_SAMPLE_N];
+        double right[BLOCK_SAMPLE_N];
+} reverb_buffers;
+
+enum {
+        /// the longest impulse response loaded, in samples
+        REVERB_MAX_RESPONSE_N = 10 * 48000,
+};
+
+/**
+ * Loads the reverb's impulse response from a 48kHz WAV file, or a
+ * generated one when source is "synthetic". Only its first two
+ * channels are used.
+ */
+static bool load_reverb(char const* source)
+{
+        std::vector<std::vector<double>> responses;
+        if (0 == strcmp(source, "synthetic")) {
+                // a two seconds tail, different for each side
+                responses.assign(2, std::vector<double>(2 * 48000));
+                for (int c = 0; c < 2; c++) {
+                        synthetic_impulse_response(&responses[c].front(),
+                                                   int64_t(responses[c].size()), 2.0, 1 + c);
+                }
+        } else {
+                MappedWav wav;
+                if (!wav.open(source)) {
+                        fprintf(stderr, "could not read %s\n", source);
+                        return false;
+                }
+                if (wav.frame_rate() != 48000 || wav.frames() == 0) {
+                        fprintf(stderr, "%s: 48kHz impulse response expected\n", source);
+                        return false;
+                }
+                int const channel_n = std::min<int>(wav.channels(), ConvolutionReverb::MAX_CHANNEL_N);
+                int64_t const frame_n = std::min<int64_t>(wav.frames(), REVERB_MAX_RESPONSE_N);
+                responses.assign(channel_n, std::vector<double>(frame_n));
+                for (int c = 0; c < channel_n; c++) {
+                        for (int64_t i = 0; i < frame_n; i++) {
+                                responses[c][i] = wav.sample(i, c);
+                        }
+                }
+        }
+
+        double const* channels[ConvolutionReverb::MAX_CHANNEL_N];
+        for (size_t c = 0; c < responses.size(); c++) {
+                normalize_impulse_response(&responses[c].front(), int64_t(responses[c].size()));
+                channels[c] = &responses[c].front();
+        }
+        reverb.load(channels, int(responses.size()), int64_t(responses.front().size()));
+        return true;
+}
+
+/// a block being rendered by voice_workers
+struct VoiceGroupsJob {
+        Patch const* patch;
+        int sample_count;
+};
+
+template <typename Math, typename VoiceParams>
+static void render_voice_group(void* context, int group)
+{
+        RtGuardScope rt_guard;
+        auto const& job = *static_cast<VoiceGroupsJob const*>(context);
+        auto const& groups = voice_groups;
+        for (int i = groups.starts[group]; i < groups.starts[group + 1]; i++) {
+                render_voice<Math, VoiceParams>(groups.voices[i], *job.patch,
+                                                job.sample_count);
+        }
+}
+
+/**
+ * Renders up to BLOCK_SAMPLE_N samples voice by voice, each voice into
+ * its own buffer, then mixes the buffers down.
+ *
+ * With ExactMath, the output differs from render_sample_major by at
+ * most RENDER_MODES_TOLERANCE, as the mid voice sums its partials in
+ * its own buffer before being mixed rather than straight into the
+ * output.
+ *
+ * When voice_workers are started, the voice groups render concurrently.
+ * Every voice still writes its own buffer and the mixdown stays on
+ * this thread, so the output is identical either way.
+ *
+ * Once the reverb is loaded, the voices are also sent to it and its
+ * return mixed in, which render_sample_major, dry, does not do.
+ *
+ * Without output buffers, every voice renders as if asleep and nothing
+ * is mixed: the phasers end up in the same state, at a fraction of the
+ * cost. The reverb is left as is.
+ */
+template <typename Math, typename VoiceParams>
+static void render_voice_major(Patch const& patch,
+                               int const sample_count,
+                               double left[/*sample_count, optional*/],
+                               double right[/*sample_count, optional*/])
+{
+        assert(sample_count <= BLOCK_SAMPLE_N);
+        auto const& buffers = voice_buffers;
+
+        phasers.advance_block(sample_count);
+
+        if (!left) {
+                for (int v = 0; v < VOICE_N; v++) {
+                        render_voice_notes(Voice(v), patch, sample_count);
+                        render_voice_buffers<Math, VoiceParams>(Voice(v), patch, sample_count,
+                                                                true);
+                }
+                return;
+        }
+
+        if (voice_workers.size() > 0) {
+                VoiceGroupsJob job = { &patch, sample_count };
+                voice_workers.run(render_voice_group<Math, VoiceParams>, &job,
+                                  voice_groups.group_n);
+        } else {
+                for (int v = 0; v < VOICE_N; v++) {
+                        render_voice<Math, VoiceParams>(Voice(v), patch, sample_count);
+                }
+        }
+
+        // mixdown, in the same order as render_sample_major
+        ParamRamp const master_gain = gain_ramp(patch, &Patch::master_gain, sample_count);
+        if (!reverb.is_loaded()) {
+                for (int i = 0; i < sample_count; i++) {
+                        double const drums = buffers.kick[i] + buffers.bounce_kick[i] +
+                                             buffers.snare[i] + buffers.hihat[i];
+                        left[i] = (drums + buffers.mid_left[i]) * master_gain.at(i);
+                        right[i] = (drums + buffers.mid_right[i]) * master_gain.at(i);
+                }
+                return;
+        }
+
+        auto& bus = reverb_buffers;
+        ParamRamp const kick_send = gain_ramp(patch, &Patch::kick_send, sample_count);
+        ParamRamp const snare_send = gain_ramp(patch, &Patch::snare_send, sample_count);
+        ParamRamp const hihat_send = gain_ramp(patch, &Patch::hihat_send, sample_count);
+        ParamRamp const mid_send = gain_ramp(patch, &Patch::mid_send, sample_count);
+        for (int i = 0; i < sample_count; i++) {
+                bus.send[i] = kick_send.at(i) * (buffers.kick[i] + buffers.bounce_kick[i]) +
+                              snare_send.at(i) * buffers.snare[i] +
+                              hihat_send.at(i) * buffers.hihat[i] +
+                              mid_send.at(i) * 0.5 * (buffers.mid_left[i] + buffers.mid_right[i]);
+        }
+        reverb.process(bus.send, sample_count, bus.left, bus.right);
+        ParamRamp const reverb_return = gain_ramp(patch, &Patch::reverb_return, sample_count);
+        for (int i = 0; i < sample_count; i++) {
+                double const drums = buffers.kick[i] + buffers.bounce_kick[i] +
+                                     buffers.snare[i] + buffers.hihat[i];
+                left[i] = (drums + buffers.mid_left[i] + reverb_return.at(i) * bus.left[i]) *
+                          master_gain.at(i);
+                right[i] = (drums + buffers.mid_right[i] + reverb_return.at(i) * bus.right[i]) *
+                           master_gain.at(i);
+        }
+}
+
+/**
+ * Renders block by block, with the voice parameters chosen by
+ * voice_params_mode and whether they move over the block.
+ */
+template <typename Math>
+static void render_voice_major_params(Patch& patch,
+                                      int const sample_count,
+                                      double left[/*sample_count*/],
+                                      double right[/*sample_count*/])
+{
+        for (int i = 0; i < sample_count; i += BLOCK_SAMPLE_N) {
+                int const n = std::min<int>(BLOCK_SAMPLE_N, sample_count - i);
+                double* const block_left = left ? &left[i] : nullptr;
+                double* const block_right = right ? &right[i] : nullptr;
+                patch_control.apply(patch, n);
+                if (voice_params_mode == VOICE_PARAMS_CONSTANT) {
+                        render_voice_major<Math, ConstantVoiceParams>(patch, n, block_left,
+                                                                      block_right);
+                } else if (patch_control.ramps_voice_params()) {
+                        render_voice_major<Math, RampedVoiceParams>(patch, n, block_left,
+                                                                    block_right);
+                } else {
+                        render_voice_major<Math, RuntimeVoiceParams>(patch, n, block_left,
+                                                                     block_right);
+                }
+        }
+}
+
+static void apply_tempo()
+{
+        double const bpm = 133.0;
+        phasers.change(shared_phasers.measure, bpm / 120.0 * 0.50);
+}
+
+/// without outputs, voice-major only, moves the engine ahead without mixing, see render_voice_major
+static void render_audio(int const sample_count,
+                         double left[/*sample_count, optional*/],
+                         double right[/*sample_count, optional*/])
+{
+        RtGuardScope rt_guard;
+        auto& patch = current_patch;
+
+        apply_tempo();
+
+        if (render_mode == RENDER_SAMPLE_MAJOR) {
+                assert(left && right);
+                // which reads the patch once per call
+                for (int i = 0; i < sample_count; i += SAMPLE_MAJOR_CONTROL_N) {
+                        int const n = std::min<int>(SAMPLE_MAJOR_CONTROL_N, sample_count - i);
+                        patch_control.apply(patch, n);
+                        render_sample_major(patch, n, &left[i], &right[i]);
+                }
+                return;
+        }
+
+        bool const incremental = envelope_mode == ENVELOPES_INCREMENTAL;
+        if (math_mode == MATH_FAST) {
+                if (incremental) {
+                        render_voice_major_params<IncrementalEnvelopes<FastMath>>(patch, sample_count,
+                                        left, right);
+                } else {
+                        render_voice_major_params<FastMath>(patch, sample_count, left, right);
+                }
+        } else {
+                if (incremental) {
+                        render_voice_major_params<IncrementalEnvelopes<ExactMath>>(patch, sample_count,
+                                        left, right);
+                } else {
+                        render_voice_major_params<ExactMath>(patch, sample_count, left, right);
+                }
+        }
+}
+
+/// renders the audio when started, rather than the device callback
+static RenderAhead render_ahead;
+
+/// what is heard, for render_next_gl3
+static AudioAnalysis audio_analysis;
+
+extern void render_next_2chn_48khz_audio(uint64_t time_micros,
+                int const sample_count, double left[/*sample_count*/],
+                double right[/*sample_count*/])
+{
+        RtGuardScope rt_guard;
+        if (render_ahead.is_running()) {
+                render_ahead.read(sample_count, left, right);
+        } else {
+                render_audio(sample_count, left, right);
+        }
+        audio_analysis.feed(left, right, sample_count);
+}
+
+enum {
+        TELEMETRY_PERIOD_MICROS = 5000000,
+};
+
+static void report_render_ahead(uint64_t const time_micros)
+{
+        static uint64_t last_report_micros = 0;
+        if (time_micros - last_report_micros < TELEMETRY_PERIOD_MICROS) {
+                return;
+        }
+        last_report_micros = time_micros;
+
+        auto const telemetry = render_ahead.telemetry();
+        printf("render ahead: fill %.1f ms (lowest %.1f ms) of %.1f ms, "
+               "%llu underruns (%.1f ms)\n",
+               telemetry.fill_frame_n / 48.0,
+               telemetry.min_fill_frame_n / 48.0,
+               render_ahead.target_frames() / 48.0,
+               (unsigned long long) telemetry.underrun_n,
+               telemetry.underrun_frame_n / 48.0);
+}
+
+/**
+ * Draws the spectrum of audio_analysis' latest frame as bars over a
+ * quad, its background lit by the levels.
+ *
+ * The magnitudes are a 1D texture, updated whenever the audio thread
+ * published a new frame since the last time.
+ */
+static void draw_analysis(uint32_t width_px, uint32_t height_px)
+{
+        static struct Resources {
+                GLuint shaders[2] = {};
+                GLuint program = 0;
+                GLuint vertex_array = 0;
+                GLuint spectrum_texture = 0;
+                GLint resolution_location = -1;
+                GLint levels_location = -1;
+        } all;
+
+        static bool must_init = true;
+        if (must_init) {
+                must_init = false;
+
+                // a quad covering the viewport, out of nothing but the vertex ids
+                char const* vertex_shader =
+                        "#version 150\n"
+                        "void main()\n"
+                        "{\n"
+                        "    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);\n"
+                        "    gl_Position = vec4(2.0 * corner - 1.0, 0.0, 1.0);\n"
+                        "}\n";
+                char const* fragment_shader =
+                        "#version 150\n"
+                        "uniform vec3 iResolution;\n"
+                        "uniform sampler1D spectrum;\n"
+                        "uniform vec4 levels; // rms left and right, peak left and right\n"
+                        "out vec4 oColor;\n"
+                        "void main()\n"
+                        "{\n"
+                        "    vec2 uv = gl_FragCoord.xy / iResolution.xy;\n"
+                        "    // frequencies on a log scale, 9 octaves below Nyquist\n"
+                        "    float magnitude = texture(spectrum, exp2(9.0 * (uv.x - 1.0))).r;\n"
+                        "    float db = 20.0 * log(max(magnitude, 1e-6)) / log(10.0);\n"
+                        "    float height = clamp(1.0 + db / 90.0, 0.0, 1.0);\n"
+                        "    float rms = uv.x < 0.5 ? levels.x : levels.y;\n"
+                        "    float peak = uv.x < 0.5 ? levels.z : levels.w;\n"
+                        "    vec3 color = vec3(0.2, 0.2, 0.3) * (1.0 + 2.0 * rms);\n"
+                        "    if (uv.y < height) {\n"
+                        "        color = mix(vec3(0.1, 0.6, 0.9), vec3(1.0, 0.4, 0.2), uv.y);\n"
+                        "    }\n"
+                        "    if (uv.y < 0.02 && fract(2.0 * uv.x) < peak) {\n"
+                        "        color = vec3(1.0);\n"
+                        "    }\n"
+                        "    oColor = vec4(color, 1.0);\n"
+                        "}\n";
+
+                struct ShaderDef {
+                        GLenum type;
+                        char const* source;
+                } const shader_defs[2] = {
+                        { GL_VERTEX_SHADER, vertex_shader },
+                        { GL_FRAGMENT_SHADER, fragment_shader },
+                };
+                all.program = glCreateProgram();
+                for (int i = 0; i < 2; i++) {
+                        GLuint const shader = glCreateShader(shader_defs[i].type);
+                        glShaderSource(shader, 1, &shader_defs[i].source, NULL);
+                        glCompileShader(shader);
+                        GLint status;
+                        glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+                        if (status == GL_FALSE) {
+                                char log[1024];
+                                glGetShaderInfoLog(shader, sizeof log, NULL, log);
+                                fprintf(stderr, "ERROR compiling shader #%d: %s\n", 1 + i, log);
+                        }
+                        glAttachShader(all.program, shader);
+                        all.shaders[i] = shader;
+                }
+                glLinkProgram(all.program);
+                all.resolution_location = glGetUniformLocation(all.program, "iResolution");
+                all.levels_location = glGetUniformLocation(all.program, "levels");
+                glUseProgram(all.program);
+                glUniform1i(glGetUniformLocation(all.program, "spectrum"), 0);
+                glUseProgram(0);
+
+                glGenVertexArrays(1, &all.vertex_array);
+
+                glGenTextures(1, &all.spectrum_texture);
+                glBindTexture(GL_TEXTURE_1D, all.spectrum_texture);
+                glTexImage1D(GL_TEXTURE_1D, 0, GL_R32F, AnalysisFrame::BIN_N, 0, GL_RED,
+                             GL_FLOAT, nullptr);
+                glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+                glBindTexture(GL_TEXTURE_1D, 0);
+        }
+
+        bool const has_new_frame = audio_analysis.update();
+        auto const& frame = audio_analysis.latest();
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_1D, all.spectrum_texture);
+        if (has_new_frame) {
+                glTexSubImage1D(GL_TEXTURE_1D, 0, 0, AnalysisFrame::BIN_N, GL_RED, GL_FLOAT,
+                                frame.magnitudes);
+        }
+
+        glUseProgram(all.program);
+        {
+                GLfloat const resolution[] = {
+                        GLfloat(width_px), GLfloat(height_px), 0.0f,
+                };
+                glUniform3fv(all.resolution_location, 1, resolution);
+                GLfloat const levels[] = {
+                        frame.rms[0], frame.rms[1], frame.peak[0], frame.peak[1],
+                };
+                glUniform4fv(all.levels_location, 1, levels);
+        }
+        glBindVertexArray(all.vertex_array);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        glBindVertexArray(0);
+        glUseProgram(0);
+        glBindTexture(GL_TEXTURE_1D, 0);
+}
+
+extern void render_next_gl3(uint64_t time_micros, struct Display display)
+{
+        parameter_sweep.send(time_micros / 1e6);
+        if (render_ahead.is_running()) {
+                report_render_ahead(time_micros);
+        }
+
+        glClearColor (0.2f, 0.2f, 0.3f, 0.0f);
+        glClear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        draw_analysis(display.framebuffer_width_px, display.framebuffer_height_px);
+}
+
+enum {
+        OFFLINE_BLOCK_SAMPLE_N = 8192,
+};
+
+/**
+ * Renders the pattern as fast as possible into a WAV file, rather than
+ * to the audio device, and reports the throughput.
+ */
+static int render_offline(char const* path, double const seconds)
+{
+        WavWriter wav;
+        if (!wav.open(path, 48000)) {
+                fprintf(stderr, "could not open %s\n", path);
+                return 1;
+        }
+
+        static double left[OFFLINE_BLOCK_SAMPLE_N];
+        static double right[OFFLINE_BLOCK_SAMPLE_N];
+        int64_t const sample_count = int64_t(seconds * 48000.0);
+
+        using std::chrono::steady_clock;
+        auto const render_start = steady_clock::now();
+        steady_clock::duration render_time {};
+        // a sweep is sent frame by frame, as the render thread would
+        int64_t const block_sample_n = parameter_sweep.is_enabled() ?
+                                       int64_t(ParameterSweep::SWEEP_FRAME_SAMPLE_N) :
+                                       int64_t(OFFLINE_BLOCK_SAMPLE_N);
+        for (int64_t i = 0; i < sample_count; i += block_sample_n) {
+                int const n = int(std::min<int64_t>(block_sample_n, sample_count - i));
+                parameter_sweep.send(i / 48000.0);
+                auto const block_start = steady_clock::now();
+                render_audio(n, left, right);
+                render_time += steady_clock::now() - block_start;
+                if (!wav.write(left, right, n)) {
+                        break;
+                }
+        }
+        auto const total_time = steady_clock::now() - render_start;
+
+        if (!wav.close()) {
+                fprintf(stderr, "could not write %s\n", path);
+                return 1;
+        }
+
+        uint64_t const violation_n = rt_guard_violations();
+        if (violation_n > 0) {
+                fprintf(stderr, "rt guard: %llu violations while rendering\n",
+                        (unsigned long long) violation_n);
+                return 1;
+        }
+
+        double const render_seconds =
+                std::chrono::duration<double>(render_time).count();
+        double const total_seconds =
+                std::chrono::duration<double>(total_time).count();
+        printf("rendered %.1f s of audio to %s in %.3f s (%.3f s rendering)\n",
+               sample_count / 48000.0, path, total_seconds, render_seconds);
+        printf("realtime factor: x%.1f, %.1f ns/sample\n",
+               sample_count / 48000.0 / render_seconds,
+               1e9 * render_seconds / sample_count);
+        if (voice_sleep.threshold > 0.0) {
+                printf("voices asleep:");
+                for (int v = 0; v < VOICE_N; v++) {
+                        printf(" %s %.0f%%", VOICE_NAMES[v],
+                               100.0 * voice_sleep.asleep_block_n[v] /
+                               std::max<uint64_t>(1, voice_sleep.block_n[v]));
+                }
+                printf("\n");
+        }
+
+        return 0;
+}
+
+/**
+ * The state rendering changes, from one call to render_audio to the
+ * next. The phasers' topology, the patterns and the modes are set up
+ * before rendering and stay the same, so they are not part of it.
+ *
+ * It is plain data, which may be copied across processes and files
+ * as is, as long as the same program reads it back.
+ */
+struct EngineSnapshot {
+        EnginePhasers::Snapshot phasers;
+        Patch patch;
+        PatchControl::Ramp ramps[PARAMETER_SMOOTHED_N];
+};
+
+/// parameter changes still in patch_control's channel are not saved
+static void snapshot_engine(EngineSnapshot* snapshot)
+{
+        phasers.snapshot(&snapshot->phasers);
+        snapshot->patch = current_patch;
+        patch_control.save_ramps(snapshot->ramps);
+}
+
+static void restore_engine(EngineSnapshot const& snapshot)
+{
+        phasers.restore(snapshot.phasers);
+        current_patch = snapshot.patch;
+        patch_control.restore_ramps(snapshot.ramps);
+}
+
+/**
+ * @returns the parts of the state which differ between a and b in any
+ * bit: phasers, or the patch and its ramps counting as one
+ */
+static size_t engine_snapshots_diff(EngineSnapshot const& a, EngineSnapshot const& b)
+{
+        size_t n = a.phasers.diff(b.phasers);
+        // patch_parameter and patch_switch only take patches to change
+        Patch patch_a = a.patch;
+        Patch patch_b = b.patch;
+        bool same_patch = true;
+        for (int i = 0; i < PARAMETER_SMOOTHED_N; i++) {
+                Parameter const parameter = Parameter(i);
+                same_patch = same_patch &&
+                             *patch_parameter(patch_a, parameter) ==
+                             *patch_parameter(patch_b, parameter) &&
+                             a.ramps[i].target == b.ramps[i].target &&
+                             a.ramps[i].remaining_n == b.ramps[i].remaining_n;
+        }
+        for (int i = PARAMETER_SMOOTHED_N + 1; i < PARAMETER_N; i++) {
+                Parameter const parameter = Parameter(i);
+                same_patch = same_patch &&
+                             *patch_switch(patch_a, parameter) ==
+                             *patch_switch(patch_b, parameter);
+        }
+        return n + (same_patch ? 0 : 1);
+}
+
+/**
+ * Moves the engine sample_count samples ahead, as render_audio called
+ * with blocks of block_sample_n samples would, without outputs.
+ *
+ * The voices still integrate their oscillators, whose increments
+ * depend on their phases, so the engine ends up in the exact state
+ * rendering would leave it in. Only voice-major rendering can skip
+ * its outputs, and the reverb's state is not moved.
+ */
+static void fast_forward_engine(int64_t const sample_count, int const block_sample_n)
+{
+        assert(render_mode == RENDER_VOICE_MAJOR && !reverb.is_loaded());
+        for (int64_t i = 0; i < sample_count; i += block_sample_n) {
+                int const n = int(std::min<int64_t>(block_sample_n, sample_count - i));
+                render_audio(n, nullptr, nullptr);
+        }
+}
+
+/// renders the frames [start, end) of a session, in offline blocks
+static void render_offline_frames(int64_t const start,
+                                  int64_t const end,
+                                  double left[/*end - start*/],
+                                  double right[/*end - start*/])
+{
+        for (int64_t i = start; i < end; i += OFFLINE_BLOCK_SAMPLE_N) {
+                int const n = int(std::min<int64_t>(OFFLINE_BLOCK_SAMPLE_N, end - i));
+                render_audio(n, &left[i - start], &right[i - start]);
+        }
+}
+
+/**
+ * Renders like render_offline, as segment_n segments rendered at once
+ * by as many processes.
+ *
+ * Each segment starts from the state fast_forward_engine leaves for
+ * its first sample, serially ahead of the forks. The seams are then
+ * bit-exact, which is checked: a segment whose predecessor ended in
+ * another state is rendered again from that state, so that the output
+ * is always the one render_offline writes.
+ *
+ * Must be called before any thread is started, rendering voice-major
+ * without the reverb, see fast_forward_engine.
+ */
+static int render_offline_segmented(char const* path,
+                                    double const seconds,
+                                    int segment_n)
+{
+        int64_t const frame_n = int64_t(seconds * 48000.0);
+        // segments start on the blocks render_offline renders
+        int64_t const block_n = (frame_n + OFFLINE_BLOCK_SAMPLE_N - 1) / OFFLINE_BLOCK_SAMPLE_N;
+        segment_n = int(std::max<int64_t>(1, std::min<int64_t>(segment_n, block_n)));
+        int64_t const segment_frame_n =
+                (block_n + segment_n - 1) / segment_n * OFFLINE_BLOCK_SAMPLE_N;
+        auto const segment_start = [&](int segment) {
+                return std::min<int64_t>(segment * segment_frame_n, frame_n);
+        };
+
+        size_t const shared_size = 2 * sizeof(double) * frame_n +
+                                   sizeof(EngineSnapshot) * segment_n;
+        void* const shared = mmap(nullptr, shared_size, PROT_READ | PROT_WRITE,
+                                  MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (shared == MAP_FAILED) {
+                fprintf(stderr, "could not map memory for the segments\n");
+                return 1;
+        }
+        double* const left = static_cast<double*>(shared);
+        double* const right = left + frame_n;
+        EngineSnapshot* const ends = reinterpret_cast<EngineSnapshot*>(right + frame_n);
+
+        using std::chrono::steady_clock;
+        auto const render_start = steady_clock::now();
+
+        // changes sent before rendering, as with --set, are part of the state
+        patch_control.apply(current_patch, 0);
+
+        std::vector<EngineSnapshot> starts(segment_n);
+        snapshot_engine(&starts[0]);
+        for (int s = 1; s < segment_n; s++) {
+                fast_forward_engine(segment_start(s) - segment_start(s - 1),
+                                    OFFLINE_BLOCK_SAMPLE_N);
+                snapshot_engine(&starts[s]);
+        }
+        auto const forward_end = steady_clock::now();
+
+        fflush(stdout);
+        fflush(stderr);
+        std::vector<pid_t> pids(segment_n, -1);
+        for (int s = 0; s < segment_n; s++) {
+                pids[s] = fork();
+                if (pids[s] == 0) {
+                        restore_engine(starts[s]);
+                        int64_t const start = segment_start(s);
+                        int64_t const end = segment_start(s + 1);
+                        render_offline_frames(start, end, &left[start], &right[start]);
+                        snapshot_engine(&ends[s]);
+                        _exit(0);
+                }
+        }
+        bool rendered = true;
+        for (int s = 0; s < segment_n; s++) {
+                int status = 0;
+                rendered = pids[s] > 0 && waitpid(pids[s], &status, 0) == pids[s] &&
+                           WIFEXITED(status) && WEXITSTATUS(status) == 0 && rendered;
+        }
+        if (!rendered) {
+                fprintf(stderr, "could not render the segments\n");
+                munmap(shared, shared_size);
+                return 1;
+        }
+        auto const parallel_end = steady_clock::now();
+
+        int exact_n = 0;
+        for (int s = 1; s < segment_n; s++) {
+                size_t const diff_n = engine_snapshots_diff(ends[s - 1], starts[s]);
+                if (diff_n == 0) {
+                        exact_n++;
+                        continue;
+                }
+                printf("seam %d: %zu parts of the state differ, rendering again\n", s, diff_n);
+                restore_engine(ends[s - 1]);
+                int64_t const start = segment_start(s);
+                int64_t const end = segment_start(s + 1);
+                render_offline_frames(start, end, &left[start], &right[start]);
+                snapshot_engine(&ends[s]);
+        }
+        auto const render_end = steady_clock::now();
+
+        WavWriter wav;
+        bool written = wav.open(path, 48000);
+        for (int64_t i = 0; written && i < frame_n; i += OFFLINE_BLOCK_SAMPLE_N) {
+                int const n = int(std::min<int64_t>(OFFLINE_BLOCK_SAMPLE_N, frame_n - i));
+                written = wav.write(&left[i], &right[i], n);
+        }
+        written = wav.close() && written;
+        munmap(shared, shared_size);
+        if (!written) {
+                fprintf(stderr, "could not write %s\n", path);
+                return 1;
+        }
+
+        double const forward_seconds =
+                std::chrono::duration<double>(forward_end - render_start).count();
+        double const parallel_seconds =
+                std::chrono::duration<double>(parallel_end - forward_end).count();
+        double const render_seconds =
+                std::chrono::duration<double>(render_end - render_start).count();
+        printf("rendered %.1f s of audio to %s in %d segments, in %.3f s "
+               "(%.3f s moving ahead, %.3f s in parallel)\n",
+               frame_n / 48000.0, path, segment_n, render_seconds, forward_seconds,
+               parallel_seconds);
+        printf("seams: %d of %d bit-exact\n", exact_n, segment_n - 1);
+        return 0;
+}
+
+/// allowed between an envelope evaluated every sample and at control rate
+static double const CONTROL_RATE_TOLERANCE = 1e-9;
+
+enum {
+        /// of which the fastest counts
+        CONTROL_RATE_TIMING_RUN_N = 5,
+};
+
+/**
+ * Measures, for every envelope of the voices, what evaluating it at
+ * control rate costs in accuracy and saves in time.
+ *
+ * Each envelope plays one note at the rate of the voice's notes.
+ *
+ * @returns false when an error exceeds CONTROL_RATE_TOLERANCE
+ */
+static bool control_rate_check(FILE* report)
+{
+        struct Envelope {
+                char const* name;
+                double attack_speed;
+                double decay_speed;
+                double increment;
+        };
+        // followers only get their increments once rendering starts
+        double const measure_increment = phasers.get_increment(shared_phasers.measure);
+        double const step_increment = 16.0 * measure_increment;
+        double kick_ratio = 0.0;
+        double snare_ratio = 0.0;
+        phasers.follows(kick_phasers.a, shared_phasers.measure, &kick_ratio);
+        phasers.follows(snare_phasers.a, kick_phasers.a, &snare_ratio);
+        double const kick_increment = kick_ratio * measure_increment;
+        double const snare_increment = snare_ratio * kick_increment;
+        Envelope const envelopes[] = {
+                {
+                        "kick amplitude", KickPreset::amplitude_env_accel,
+                        KickPreset::amplitude_env_decay, kick_increment,
+                },
+                {
+                        "kick frequency", KickPreset::freq_env_accel,
+                        KickPreset::freq_env_decay, kick_increment,
+                },
+                {
+                        "bounce-kick amplitude", BounceKickPreset::amplitude_env_accel,
+                        BounceKickPreset::amplitude_env_decay, step_increment,
+                },
+                {
+                        "snare amplitude", SnarePreset::amplitude_env_accel,
+                        SnarePreset::amplitude_env_decay, snare_increment,
+                },
+                {
+                        "snare frequency", SnarePreset::freq_env_accel,
+                        SnarePreset::freq_env_decay, snare_increment,
+                },
+                {
+                        "hihat amplitude", HihatPreset::amplitude_env_accel,
+                        HihatPreset::amplitude_env_decay, step_increment,
+                },
+                {
+                        "hihat frequency", HihatPreset::freq_env_accel,
+                        HihatPreset::freq_env_decay, step_increment,
+                },
+                {
+                        "mid amplitude", MidPreset::amplitude_env_accel,
+                        MidPreset::amplitude_env_decay, phasers.get_increment(mid_phasers.m),
+                },
+        };
+        int const periods[] = { 1, 16, 32, 64 };
+
+        using std::chrono::steady_clock;
+        int failure_n = 0;
+        for (auto const& envelope : envelopes) {
+                int const note_n = int(std::ceil(1.0 / envelope.increment));
+                fprintf(report, "control rate: %-22s", envelope.name);
+                for (int period : periods) {
+                        double phases[BLOCK_SAMPLE_N];
+                        double expected[BLOCK_SAMPLE_N];
+                        double values[BLOCK_SAMPLE_N];
+                        double max_error = 0.0;
+                        steady_clock::duration fastest = steady_clock::duration::max();
+                        for (int run = 0; run < CONTROL_RATE_TIMING_RUN_N; run++) {
+                                steady_clock::duration time {};
+                                for (int start = 0; start < note_n; start += BLOCK_SAMPLE_N) {
+                                        int const n = std::min<int>(BLOCK_SAMPLE_N, note_n - start);
+                                        for (int i = 0; i < n; i++) {
+                                                phases[i] = phaser_wrap((start + i) *
+                                                                        envelope.increment);
+                                        }
+                                        ExactMath::sinexpenv_block(phases, n, envelope.attack_speed,
+                                                                   envelope.decay_speed, expected);
+                                        auto const block_start = steady_clock::now();
+                                        control_rate_sinexpenv_block<ExactMath>(phases, n,
+                                                        envelope.attack_speed,
+                                                        envelope.decay_speed,
+                                                        period, values);
+                                        time += steady_clock::now() - block_start;
+                                        for (int i = 0; i < n; i++) {
+                                                max_error = std::max(max_error,
+                                                                     std::fabs(values[i] - expected[i]));
+                                        }
+                                }
+                                fastest = std::min(fastest, time);
+                        }
+                        double const ns_per_sample =
+                                1e9 * std::chrono::duration<double>(fastest).count() / note_n;
+                        fprintf(report, "  %2d: %.1e %5.1f ns", period, max_error, ns_per_sample);
+                        failure_n += max_error <= CONTROL_RATE_TOLERANCE ? 0 : 1;
+                }
+                fprintf(report, "\n");
+        }
+
+        fprintf(report, "control rate: %s\n", failure_n == 0 ? "ok" : "FAILED");
+        return failure_n == 0;
+}
+
+enum {
+        VOICE_SLEEP_CHECK_SECONDS = 20,
+};
+
+/// -40 dB, for every voice to sleep at some point
+static double const VOICE_SLEEP_CHECK_THRESHOLD = 1e-2;
+
+/**
+ * Renders every block twice from the same state, voices sleeping or
+ * not, with the exact and the fast math.
+ *
+ * @returns false unless both leave the engine in the same state, the
+ * voices awake in both output the same bits, and the voices asleep
+ * would have output no more than the threshold
+ */
+static bool voice_sleep_check(FILE* report)
+{
+        static double left[BLOCK_SAMPLE_N];
+        static double right[BLOCK_SAMPLE_N];
+        static EngineSnapshot start, awake_end, sleeping_end;
+        static VoiceBuffers awake_buffers;
+        MathMode const math_modes[] = { MATH_EXACT, MATH_FAST };
+        char const* const math_names[] = { "exact", "fast" };
+
+        EngineSnapshot initial;
+        snapshot_engine(&initial);
+        render_mode = RENDER_VOICE_MAJOR;
+        int failure_n = 0;
+        for (int m = 0; m < 2; m++) {
+                math_mode = math_modes[m];
+                restore_engine(initial);
+                uint64_t asleep_block_n[VOICE_N] = {};
+                size_t state_diff_n = 0;
+                int64_t changed_n = 0;
+                double max_asleep_level = 0.0;
+                int const block_n = VOICE_SLEEP_CHECK_SECONDS * 48000 / BLOCK_SAMPLE_N;
+                for (int b = 0; b < block_n; b++) {
+                        snapshot_engine(&start);
+                        voice_sleep.threshold = 0.0;
+                        render_audio(BLOCK_SAMPLE_N, left, right);
+                        snapshot_engine(&awake_end);
+                        awake_buffers = voice_buffers;
+
+                        restore_engine(start);
+                        uint64_t asleep_before[VOICE_N];
+                        std::copy(voice_sleep.asleep_block_n,
+                                  voice_sleep.asleep_block_n + VOICE_N, asleep_before);
+                        voice_sleep.threshold = VOICE_SLEEP_CHECK_THRESHOLD;
+                        render_audio(BLOCK_SAMPLE_N, left, right);
+                        snapshot_engine(&sleeping_end);
+                        state_diff_n += engine_snapshots_diff(awake_end, sleeping_end);
+
+                        for (int v = 0; v < VOICE_N; v++) {
+                                bool const asleep =
+                                        voice_sleep.asleep_block_n[v] != asleep_before[v];
+                                asleep_block_n[v] += asleep;
+                                double* awake_outs[2];
+                                double* outs[2];
+                                int const out_n = voice_outputs(Voice(v), awake_buffers,
+                                                                awake_outs);
+                                voice_outputs(Voice(v), voice_buffers, outs);
+                                for (int o = 0; o < out_n; o++) {
+                                        for (int i = 0; i < BLOCK_SAMPLE_N; i++) {
+                                                if (asleep) {
+                                                        max_asleep_level =
+                                                                std::max(max_asleep_level,
+                                                                         std::fabs(awake_outs[o][i]));
+                                                        changed_n += outs[o][i] != 0.0;
+                                                } else {
+                                                        changed_n += outs[o][i] != awake_outs[o][i];
+                                                }
+                                        }
+                                }
+                        }
+                }
+
+                bool const passed = state_diff_n == 0 && changed_n == 0 &&
+                                    max_asleep_level <= VOICE_SLEEP_CHECK_THRESHOLD;
+                fprintf(report, "voice sleep: %-5s asleep", math_names[m]);
+                for (int v = 0; v < VOICE_N; v++) {
+                        fprintf(report, " %s %.0f%%", VOICE_NAMES[v],
+                                100.0 * asleep_block_n[v] / block_n);
+                }
+                fprintf(report, ", states differing %zu, samples differing %lld, "
+                        "max level asleep %.1e %s\n",
+                        state_diff_n, (long long) changed_n, max_asleep_level,
+                        passed ? "ok" : "FAILED");
+                failure_n += passed ? 0 : 1;
+        }
+        voice_sleep.threshold = 0.0;
+
+        fprintf(report, "voice sleep: %s\n", failure_n == 0 ? "ok" : "FAILED");
+        return failure_n == 0;
+}
+
+enum {
+        REGRESSION_SECONDS = 10,
+        REGRESSION_FRAME_N = REGRESSION_SECONDS * 48000,
+        /// left and right, interleaved
+        REGRESSION_SAMPLE_N = 2 * REGRESSION_FRAME_N,
+        /// renders timed per configuration, of which the median counts
+        REGRESSION_TIMING_RUN_N = 5,
+};
+
+/// a configuration is not compared with the reference
+static double const NOT_COMPARED = -1.0;
+
+/// allowed between an output and its golden samples
+static double const REGRESSION_GOLDEN_TOLERANCE = 1e-9;
+
+/**
+ * Where the golden_hash of REGRESSION_CONFIGS were rendered: GCC 12.2
+ * on x86-64, with SSE2 doubles and no FMA. Other builds round
+ * differently, and only check against the baselines they record.
+ */
+static char const* const REGRESSION_GOLDEN_PLATFORM = "x86-64 GCC 12.2, SSE2, no FMA";
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__) && \
+        !defined(__FP_FAST_FMA) && !defined(__FAST_MATH__)
+static bool const REGRESSION_GOLDEN_CHECKED = true;
+#else
+static bool const REGRESSION_GOLDEN_CHECKED = false;
+#endif
+
+/// -100 dB
+static double const VOICE_SLEEP_REGRESSION_THRESHOLD = 1e-5;
+
+struct RegressionConfig {
+        char const* name;
+        RenderMode render_mode;
+        MathMode math_mode;
+        EnvelopeMode envelope_mode;
+        VoiceParamsMode voice_params_mode;
+        /// voice_workers to start, -1 for one per voice group but ours, see start_voice_workers
+        int voice_thread_n;
+        /// of every voice, see ControlRates
+        int control_period;
+        /// see VoiceSleep
+        double voice_sleep_threshold;
+        /// with the synthetic reverb, see load_reverb
+        bool reverb;
+        /// allowed between the output and the reference's, or NOT_COMPARED
+        double reference_tolerance;
+        /// of the output, as rendered on REGRESSION_GOLDEN_PLATFORM, see run_regression
+        uint64_t golden_hash;
+};
+
+/**
+ * The first configuration is the reference. The approximations of the
+ * others send the FM drums, which feed back, on another trajectory
+ * after a few seconds, so those are only compared with their own
+ * golden samples.
+ */
+static RegressionConfig const REGRESSION_CONFIGS[] = {
+        {
+                "reference", RENDER_SAMPLE_MAJOR, MATH_EXACT, ENVELOPES_CLOSED_FORM,
+                VOICE_PARAMS_RUNTIME, 0, 1, 0.0, false, NOT_COMPARED,
+                0xcd27da5b203b28e9ULL,
+        },
+        {
+                "voice-major", RENDER_VOICE_MAJOR, MATH_EXACT, ENVELOPES_CLOSED_FORM,
+                VOICE_PARAMS_RUNTIME, 0, 1, 0.0, false, RENDER_MODES_TOLERANCE,
+                0xf776123515afd1f5ULL,
+        },
+        {
+                "voice-threads", RENDER_VOICE_MAJOR, MATH_EXACT, ENVELOPES_CLOSED_FORM,
+                VOICE_PARAMS_RUNTIME, -1, 1, 0.0, false, RENDER_MODES_TOLERANCE,
+                0xf776123515afd1f5ULL,
+        },
+        {
+                "constant-params", RENDER_VOICE_MAJOR, MATH_EXACT, ENVELOPES_CLOSED_FORM,
+                VOICE_PARAMS_CONSTANT, 0, 1, 0.0, false, RENDER_MODES_TOLERANCE,
+                0xf776123515afd1f5ULL,
+        },
+        {
+                "incremental-envelopes", RENDER_VOICE_MAJOR, MATH_EXACT, ENVELOPES_INCREMENTAL,
+                VOICE_PARAMS_RUNTIME, 0, 1, 0.0, false, NOT_COMPARED,
+                0xd2fb958de03e66f0ULL,
+        },
+        {
+                "fast-math", RENDER_VOICE_MAJOR, MATH_FAST, ENVELOPES_CLOSED_FORM,
+                VOICE_PARAMS_RUNTIME, 0, 1, 0.0, false, NOT_COMPARED,
+                0x19c8e8ae546dd331ULL,
+        },
+        {
+                "fast-incremental", RENDER_VOICE_MAJOR, MATH_FAST, ENVELOPES_INCREMENTAL,
+                VOICE_PARAMS_RUNTIME, 0, 1, 0.0, false, NOT_COMPARED,
+                0x99309de00d38e31cULL,
+        },
+        {
+                "control-rate-32", RENDER_VOICE_MAJOR, MATH_EXACT, ENVELOPES_CLOSED_FORM,
+                VOICE_PARAMS_RUNTIME, 0, 32, 0.0, false, NOT_COMPARED,
+                0x0b54098c4c4636eaULL,
+        },
+        {
+                "fast-control-rate-32", RENDER_VOICE_MAJOR, MATH_FAST, ENVELOPES_CLOSED_FORM,
+                VOICE_PARAMS_RUNTIME, 0, 32, 0.0, false, NOT_COMPARED,
+                0xeeca32572b7075eaULL,
+        },
+        {
+                "voice-sleep", RENDER_VOICE_MAJOR, MATH_EXACT, ENVELOPES_CLOSED_FORM,
+                VOICE_PARAMS_RUNTIME, 0, 1, VOICE_SLEEP_REGRESSION_THRESHOLD, false, NOT_COMPARED,
+                0xf34c9ca5bd435764ULL,
+        },
+        {
+                "reverb", RENDER_VOICE_MAJOR, MATH_EXACT, ENVELOPES_CLOSED_FORM,
+                VOICE_PARAMS_RUNTIME, 0, 1, 0.0, true, NOT_COMPARED,
+                0xe743a9ab0f15a6ceULL,
+        },
+};
+
+enum {
+        REGRESSION_CONFIG_N = sizeof REGRESSION_CONFIGS / sizeof REGRESSION_CONFIGS[0],
+};
+
+/// what a child process hands back about its render
+struct RegressionRun {
+        double ns_per_sample;
+        double voice_ns_per_sample[VOICE_N];
+};
+
+static void regression_render(RegressionConfig const& config,
+                              double samples[/*REGRESSION_SAMPLE_N*/],
+                              RegressionRun* run)
+{
+        render_mode = config.render_mode;
+        math_mode = config.math_mode;
+        envelope_mode = config.envelope_mode;
+        voice_params_mode = config.voice_params_mode;
+        control_rates.set_all(config.control_period);
+        voice_sleep.threshold = config.voice_sleep_threshold;
+        if (config.reverb) {
+                load_reverb("synthetic");
+        }
+        start_voice_workers(config.voice_thread_n < 0 ?
+                            voice_groups.group_n - 1 : config.voice_thread_n);
+        voice_times.enabled = true;
+
+        static double left[OFFLINE_BLOCK_SAMPLE_N];
+        static double right[OFFLINE_BLOCK_SAMPLE_N];
+
+        using std::chrono::steady_clock;
+        steady_clock::duration render_time {};
+        for (int i = 0; i < REGRESSION_FRAME_N; i += OFFLINE_BLOCK_SAMPLE_N) {
+                int const n = std::min<int>(OFFLINE_BLOCK_SAMPLE_N, REGRESSION_FRAME_N - i);
+                auto const block_start = steady_clock::now();
+                render_audio(n, left, right);
+                render_time += steady_clock::now() - block_start;
+                for (int j = 0; j < n; j++) {
+                        samples[2 * (i + j)] = left[j];
+                        samples[2 * (i + j) + 1] = right[j];
+                }
+        }
+        voice_workers.stop();
+
+        double const ns_per_sample = 1e9 / REGRESSION_FRAME_N;
+        run->ns_per_sample = ns_per_sample *
+                             std::chrono::duration<double>(render_time).count();
+        for (int v = 0; v < VOICE_N; v++) {
+                run->voice_ns_per_sample[v] = ns_per_sample * voice_times.seconds[v];
+        }
+}
+
+/**
+ * Renders config in a child process, so that every configuration
+ * starts from the state the engine has at startup.
+ *
+ * @returns false when the child could not render
+ */
+static bool fork_regression_render(RegressionConfig const& config,
+                                   double shared_samples[/*REGRESSION_SAMPLE_N*/],
+                                   RegressionRun* shared_run)
+{
+        fflush(stdout);
+        fflush(stderr);
+        pid_t const pid = fork();
+        if (pid < 0) {
+                return false;
+        }
+        if (pid == 0) {
+                regression_render(config, shared_samples, shared_run);
+                _exit(0);
+        }
+        int status;
+        if (waitpid(pid, &status, 0) != pid) {
+                return false;
+        }
+        return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/**
+ * Renders REGRESSION_SECONDS of the pattern in every configuration of
+ * REGRESSION_CONFIGS, and checks them against the baselines kept in
+ * directory.
+ *
+ * A configuration fails when:
+ * - it, or the reference it is compared with, could not render
+ * - its output differs from the reference by more than its tolerance
+ * - it has no baseline yet, and its hash is not the golden_hash
+ *   committed in REGRESSION_CONFIGS, when built like
+ *   REGRESSION_GOLDEN_PLATFORM
+ * - its hash changed and its output differs from its golden samples by
+ *   more than REGRESSION_GOLDEN_TOLERANCE
+ * - the median of its timed renders is more than max_slowdown slower
+ *   than its baseline
+ *
+ * Configurations without a baseline, or all of them when record is
+ * set, have their output and speed recorded as the new baseline
+ * instead, unless any configuration failed. Their speed is only
+ * comparable on the same machine. With record set, the committed
+ * hashes are not checked, and the new ones are printed to update them.
+ * Other compilers and architectures skip the committed hashes, and
+ * record their first outputs as they are. Builds of the same platform
+ * rounding differently, with another libm, have to start by recording.
+ *
+ * Changes from --set or --pattern reach every configuration, and so
+ * fail the golden checks.
+ *
+ * @returns the exit status: 0 when every configuration passed
+ */
+static int run_regression(char const* directory,
+                          bool const record,
+                          double const max_slowdown)
+{
+        char baselines_path[1024];
+        snprintf(baselines_path, sizeof baselines_path, "%s/baselines.txt", directory);
+
+        RegressionBaseline baselines[REGRESSION_CONFIG_N];
+        int const baseline_n = record ? 0 :
+                               load_regression_baselines(baselines_path, baselines,
+                                                         REGRESSION_CONFIG_N);
+
+        size_t const shared_size = sizeof(double) * REGRESSION_SAMPLE_N + sizeof(RegressionRun);
+        void* const shared = mmap(nullptr, shared_size, PROT_READ | PROT_WRITE,
+                                  MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (shared == MAP_FAILED) {
+                fprintf(stderr, "regression: could not map memory for the renders\n");
+                return 1;
+        }
+        double* const samples = static_cast<double*>(shared);
+        RegressionRun* const run = reinterpret_cast<RegressionRun*>(samples + REGRESSION_SAMPLE_N);
+
+        std::vector<double> reference(REGRESSION_SAMPLE_N);
+        std::vector<double> golden(REGRESSION_SAMPLE_N);
+        RegressionBaseline results[REGRESSION_CONFIG_N] = {};
+        bool has_reference = false;
+        bool recorded = false;
+        int failure_n = 0;
+
+        printf("regression: %d s per configuration, baselines in %s\n",
+               int(REGRESSION_SECONDS), directory);
+        if (!REGRESSION_GOLDEN_CHECKED && !record) {
+                printf("regression: the committed hashes are from %s, skipped in this build\n",
+                       REGRESSION_GOLDEN_PLATFORM);
+        }
+        for (int c = 0; c < REGRESSION_CONFIG_N; c++) {
+                auto const& config = REGRESSION_CONFIGS[c];
+                auto& result = results[c];
+                char golden_path[1024];
+                snprintf(golden_path, sizeof golden_path, "%s/%s.f64", directory, config.name);
+
+                RegressionRun runs[REGRESSION_TIMING_RUN_N];
+                bool rendered = true;
+                for (int r = 0; r < REGRESSION_TIMING_RUN_N && rendered; r++) {
+                        rendered = fork_regression_render(config, samples, run);
+                        runs[r] = *run;
+                }
+                if (!rendered) {
+                        printf("%-22s FAILED to render\n", config.name);
+                        failure_n++;
+                        continue;
+                }
+                if (c == 0) {
+                        std::copy(samples, samples + REGRESSION_SAMPLE_N, reference.begin());
+                        has_reference = true;
+                }
+                // less sensitive than the fastest run to a lucky one
+                std::sort(runs, runs + REGRESSION_TIMING_RUN_N,
+                          [](RegressionRun const& a, RegressionRun const& b) {
+                                  return a.ns_per_sample < b.ns_per_sample;
+                          });
+                RegressionRun const& median = runs[REGRESSION_TIMING_RUN_N / 2];
+
+                snprintf(result.name, sizeof result.name, "%s", config.name);
+                result.hash = samples_hash(samples, REGRESSION_SAMPLE_N);
+                result.ns_per_sample = median.ns_per_sample;
+                // sample by sample, the voices cannot be timed apart
+                result.voice_n = config.render_mode == RENDER_SAMPLE_MAJOR ? 0 : VOICE_N;
+                std::copy(median.voice_ns_per_sample, median.voice_ns_per_sample + VOICE_N,
+                          result.voice_ns_per_sample);
+
+                bool passed = true;
+                char const* verdict = "identical";
+                if (config.reference_tolerance != NOT_COMPARED && !has_reference) {
+                        printf("%-22s has no reference to compare with\n", config.name);
+                        passed = false;
+                } else if (config.reference_tolerance != NOT_COMPARED) {
+                        SamplesDiff const diff = samples_diff(samples, reference.data(),
+                                                              REGRESSION_SAMPLE_N,
+                                                              config.reference_tolerance);
+                        if (diff.over_n > 0) {
+                                printf("%-22s differs from the reference by up to %g, from sample %lld\n",
+                                       config.name, diff.max_diff, (long long) diff.first_index);
+                                passed = false;
+                        }
+                }
+
+                RegressionBaseline const* const baseline =
+                        find_regression_baseline(baselines, baseline_n, config.name);
+                double slowdown = 0.0;
+                if (!baseline && !record && REGRESSION_GOLDEN_CHECKED &&
+                    result.hash != config.golden_hash) {
+                        printf("%-22s hashes to %016llx instead of its committed %016llx\n",
+                               config.name, (unsigned long long) result.hash,
+                               (unsigned long long) config.golden_hash);
+                        passed = false;
+                } else if (!baseline && passed) {
+                        verdict = record ? "recorded" :
+                                  REGRESSION_GOLDEN_CHECKED ? "golden" : "golden skipped";
+                        if (!save_samples(golden_path, samples, REGRESSION_SAMPLE_N)) {
+                                fprintf(stderr, "regression: could not write %s\n", golden_path);
+                                return 1;
+                        }
+                        recorded = true;
+                } else if (baseline) {
+                        if (result.hash != baseline->hash) {
+                                verdict = "within tolerance";
+                                if (!load_samples(golden_path, golden.data(), REGRESSION_SAMPLE_N)) {
+                                        printf("%-22s changed, and has no golden samples in %s\n",
+                                               config.name, golden_path);
+                                        passed = false;
+                                } else {
+                                        SamplesDiff const diff =
+                                                samples_diff(samples, golden.data(),
+                                                             REGRESSION_SAMPLE_N,
+                                                             REGRESSION_GOLDEN_TOLERANCE);
+                                        if (diff.over_n > 0) {
+                                                printf("%-22s differs from its golden samples by up to %g, from sample %lld\n",
+                                                       config.name, diff.max_diff,
+                                                       (long long) diff.first_index);
+                                                passed = false;
+                                        }
+                                }
+                        }
+                        slowdown = result.ns_per_sample / baseline->ns_per_sample - 1.0;
+                        if (slowdown > max_slowdown) {
+                                printf("%-22s is %.1f%% slower than its baseline\n",
+                                       config.name, 100.0 * slowdown);
+                                passed = false;
+                        }
+                        // keeps the baseline, so that slowdowns cannot creep in
+                        result = *baseline;
+                }
+
+                printf("%-22s %-16s %8.1f ns/sample %+6.1f%%%s\n", config.name,
+                       passed ? verdict : "FAILED", median.ns_per_sample, 100.0 * slowdown,
+                       baseline || !passed ? "" : " (new baseline)");
+                if (record) {
+                        printf("%-22s hash %016llx\n", "", (unsigned long long) result.hash);
+                }
+                if (config.render_mode != RENDER_SAMPLE_MAJOR) {
+                        printf("%-22s", "");
+                        for (int v = 0; v < VOICE_N; v++) {
+                                printf(" %s %.1f", VOICE_NAMES[v], median.voice_ns_per_sample[v]);
+                        }
+                        printf("\n");
+                }
+                failure_n += passed ? 0 : 1;
+        }
+        munmap(shared, shared_size);
+
+        if (recorded && failure_n > 0) {
+                // the results of the failed configurations are not baselines
+                printf("regression: not recording baselines, as some configurations failed\n");
+        } else if (recorded &&
+                   !save_regression_baselines(baselines_path, results, REGRESSION_CONFIG_N)) {
+                fprintf(stderr, "regression: could not write %s\n", baselines_path);
+                return 1;
+        }
+
+        printf("regression: %s\n", failure_n == 0 ? "ok" : "FAILED");
+        return failure_n == 0 ? 0 : 1;
+}
+
+int main (int argc, char** argv)
+{
+        // the audio thread renders voices too
+        int voice_thread_n = int(std::thread::hardware_concurrency()) - 1;
+        char const* offline_path = nullptr;
+        double offline_seconds = 60.0;
+        int offline_segment_n = 1;
+        double render_ahead_ms = 0.0;
+        char const* regression_directory = nullptr;
+        bool regression_record = false;
+        // on top of the median of REGRESSION_TIMING_RUN_N renders; noisy
+        // machines may loosen it, or opt out with a large --max-slowdown
+        double regression_max_slowdown = 0.10;
+        char const* reverb_source = nullptr;
+        for (int i = 1; i < argc; i++) {
+                if (0 == strcmp(argv[i], "--fast-math")) {
+                        math_mode = MATH_FAST;
+                } else if (0 == strcmp(argv[i], "--incremental-envelopes")) {
+                        envelope_mode = ENVELOPES_INCREMENTAL;
+                } else if (0 == strcmp(argv[i], "--constant-params")) {
+                        voice_params_mode = VOICE_PARAMS_CONSTANT;
+                } else if (0 == strcmp(argv[i], "--control-rate") && i + 2 < argc) {
+                        // a voice name or all, and the samples between evaluations
+                        int const period = std::max(1, std::min(atoi(argv[i + 2]),
+                                                                int(MAX_CONTROL_PERIOD)));
+                        Voice voice;
+                        if (0 == strcmp(argv[i + 1], "all")) {
+                                control_rates.set_all(period);
+                        } else if (find_voice(argv[i + 1], &voice)) {
+                                control_rates.periods[voice] = period;
+                        } else {
+                                fprintf(stderr, "unknown voice: %s\n", argv[i + 1]);
+                                return 1;
+                        }
+                        i += 2;
+                } else if (0 == strcmp(argv[i], "--voice-sleep") && i + 1 < argc) {
+                        // in dB relative to full scale
+                        voice_sleep.threshold = pow(10.0, atof(argv[++i]) / 20.0);
+                } else if (0 == strcmp(argv[i], "--voice-threads") && i + 1 < argc) {
+                        voice_thread_n = atoi(argv[++i]);
+                } else if (0 == strcmp(argv[i], "--reverb") && i + 1 < argc) {
+                        // a WAV file or synthetic
+                        reverb_source = argv[++i];
+                } else if (0 == strcmp(argv[i], "--set") && i + 2 < argc) {
+                        // sent before the render thread takes over the channel
+                        Parameter parameter;
+                        if (!find_parameter(argv[i + 1], &parameter)) {
+                                fprintf(stderr, "unknown parameter: %s\n", argv[i + 1]);
+                                return 1;
+                        }
+                        patch_control.send(parameter, atof(argv[i + 2]));
+                        i += 2;
+                } else if (0 == strcmp(argv[i], "--sweep") && i + 4 < argc) {
+                        // a parameter, the values between which it goes and in how long
+                        if (!find_parameter(argv[i + 1], &parameter_sweep.parameter) ||
+                            !patch_parameter(current_patch, parameter_sweep.parameter)) {
+                                fprintf(stderr, "unknown parameter: %s\n", argv[i + 1]);
+                                return 1;
+                        }
+                        parameter_sweep.from = atof(argv[i + 2]);
+                        parameter_sweep.to = atof(argv[i + 3]);
+                        parameter_sweep.period_seconds = std::max(1e-3, atof(argv[i + 4]));
+                        i += 4;
+                } else if (0 == strcmp(argv[i], "--offline") && i + 1 < argc) {
+                        offline_path = argv[++i];
+                } else if (0 == strcmp(argv[i], "--segments") && i + 1 < argc) {
+                        offline_segment_n = atoi(argv[++i]);
+                } else if (0 == strcmp(argv[i], "--seconds") && i + 1 < argc) {
+                        offline_seconds = atof(argv[++i]);
+                } else if (0 == strcmp(argv[i], "--pattern") && i + 2 < argc) {
+                        Pattern* const pattern = patterns.find(argv[i + 1]);
+                        if (!pattern || !pattern->parse(argv[i + 2])) {
+                                fprintf(stderr, "could not load pattern %s\n", argv[i + 1]);
+                                return 1;
+                        }
+                        i += 2;
+                } else if (0 == strcmp(argv[i], "--render-ahead") && i + 1 < argc) {
+                        render_ahead_ms = atof(argv[++i]);
+                } else if (0 == strcmp(argv[i], "--regression") && i + 1 < argc) {
+                        regression_directory = argv[++i];
+                } else if (0 == strcmp(argv[i], "--record")) {
+                        regression_record = true;
+                } else if (0 == strcmp(argv[i], "--max-slowdown") && i + 1 < argc) {
+                        regression_max_slowdown = atof(argv[++i]);
+                } else if (0 == strcmp(argv[i], "--check-fastmath")) {
+                        return fastmath_check(stdout) ? 0 : 1;
+                } else if (0 == strcmp(argv[i], "--check-control-rate")) {
+                        return control_rate_check(stdout) ? 0 : 1;
+                } else if (0 == strcmp(argv[i], "--check-voice-sleep")) {
+                        return voice_sleep_check(stdout) ? 0 : 1;
+                } else if (0 == strcmp(argv[i], "--check-phasers")) {
+                        return phasers_check(stdout) ? 0 : 1;
+                } else if (0 == strcmp(argv[i], "--check-analysis")) {
+                        return analysis_check(stdout) ? 0 : 1;
+                } else if (0 == strcmp(argv[i], "--check-convolution")) {
+                        return convolution_check(stdout) ? 0 : 1;
+                }
+        }
+
+        if (regression_directory) {
+                // before any thread is started, as configurations render in forks
+                return run_regression(regression_directory, regression_record,
+                                      regression_max_slowdown);
+        }
+
+        if (reverb_source && !load_reverb(reverb_source)) {
+                return 1;
+        }
+
+        if (offline_path && offline_seconds * 48000.0 > double(WavWriter::MAX_FRAME_N)) {
+                fprintf(stderr, "--seconds: a WAV file holds at most %.0f s at 48kHz\n",
+                        double(WavWriter::MAX_FRAME_N) / 48000.0);
+                return 1;
+        }
+
+        // the reverb's state is not part of EngineSnapshot, and sample by
+        // sample the state can only be moved ahead by rendering: both
+        // render serially, as do sweeps, sent as the render goes
+        if (offline_path && offline_segment_n > 1 && !reverb.is_loaded() &&
+            !parameter_sweep.is_enabled() && render_mode == RENDER_VOICE_MAJOR) {
+                // segments render in forks
+                return render_offline_segmented(offline_path, offline_seconds,
+                                                offline_segment_n);
+        }
+
+        start_voice_workers(voice_thread_n);
+
+        if (offline_path) {
+                // with the reverb's tail convolved inline, for a deterministic output
+                return render_offline(offline_path, offline_seconds);
+        }
+
+        reverb.start_tail_thread();
+
+        if (render_ahead_ms > 0.0) {
+                render_ahead.start(render_audio, render_ahead_ms);
+        }
 
         runtime_init();
 
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+/**
+ * Fourier transform of real signals of n samples, n a power of two,
+ * computed as a complex transform of n/2 points.
+ *
+ * Spectra are the n/2 + 1 bins from 0 to Nyquist, as separate real
+ * and imaginary parts. inverse(forward(x)) is x.
+ *
+ * Holds its own scratch buffers, so one instance serves one thread.
+ */
+class RealFft
+{
+public:
+        explicit RealFft(int n) :
+                n(n),
+                m(n / 2),
+                bit_reversed(m),
+                w_re(m),
+                w_im(m),
+                real_w_re(m + 1),
+                real_w_im(m + 1),
+                z_re(m),
+                z_im(m)
+        {
+                double const tau = 8.0 * std::atan(1.0);
+                int bits = 0;
+                while ((1 << bits) < m) {
+                        bits++;
+                }
+                for (int i = 0; i < m; i++) {
+                        int reversed = 0;
+                        for (int b = 0; b < bits; b++) {
+                                reversed |= ((i >> b) & 1) << (bits - 1 - b);
+                        }
+                        bit_reversed[i] = reversed;
+                }
+                for (int half = 1; half < m; half *= 2) {
+                        for (int k = 0; k < half; k++) {
+                                w_re[half + k] = std::cos(tau * k / (2 * half));
+                                w_im[half + k] = -std::sin(tau * k / (2 * half));
+                        }
+                }
+                for (int k = 0; k <= m; k++) {
+                        real_w_re[k] = std::cos(tau * k / n);
+                        real_w_im[k] = -std::sin(tau * k / n);
+                }
+        }
+
+        int size() const
+        {
+                return n;
+        }
+
+        int bin_n() const
+        {
+                return m + 1;
+        }
+
+        void forward(double const in[/*n*/], double re[/*n/2 + 1*/], double im[/*n/2 + 1*/])
+        {
+                // even samples as real parts, odd samples as imaginary parts
+                for (int i = 0; i < m; i++) {
+                        z_re[bit_reversed[i]] = in[2 * i];
+                        z_im[bit_reversed[i]] = in[2 * i + 1];
+                }
+                complex_forward(&z_re.front(), &z_im.front());
+
+                // separated into the spectra of even and odd samples
+                for (int k = 0; k <= m; k++) {
+                        int const a = k == m ? 0 : k;
+                        int const b = k == 0 ? 0 : m - k;
+                        double const even_re = 0.5 * (z_re[a] + z_re[b]);
+                        double const even_im = 0.5 * (z_im[a] - z_im[b]);
+                        double const odd_re = 0.5 * (z_im[a] + z_im[b]);
+                        double const odd_im = -0.5 * (z_re[a] - z_re[b]);
+                        re[k] = even_re + real_w_re[k] * odd_re - real_w_im[k] * odd_im;
+                        im[k] = even_im + real_w_re[k] * odd_im + real_w_im[k] * odd_re;
+                }
+        }
+
+        void inverse(double const re[/*n/2 + 1*/], double const im[/*n/2 + 1*/], double out[/*n*/])
+        {
+                double const scale = 0.5 / m;
+                for (int k = 0; k < m; k++) {
+                        double const c_re = re[m - k];
+                        double const c_im = -im[m - k];
+                        double const even_re = re[k] + c_re;
+                        double const even_im = im[k] + c_im;
+                        double const d_re = re[k] - c_re;
+                        double const d_im = im[k] - c_im;
+                        // (x[k] - conj(x[m - k])) times the conjugated twiddle
+                        double const odd_re = d_re * real_w_re[k] + d_im * real_w_im[k];
+                        double const odd_im = d_im * real_w_re[k] - d_re * real_w_im[k];
+                        z_re[bit_reversed[k]] = scale * (even_re - odd_im);
+                        z_im[bit_reversed[k]] = scale * (even_im + odd_re);
+                }
+                // the inverse transform is the forward one, real and imaginary swapped
+                complex_forward(&z_im.front(), &z_re.front());
+                for (int i = 0; i < m; i++) {
+                        out[2 * i] = z_re[i];
+                        out[2 * i + 1] = z_im[i];
+                }
+        }
+
+private:
+        /**
+         * In place, radix 2, decimating in time, from inputs stored at
+         * their bit reversed indices.
+         */
+        void complex_forward(double re[/*m*/], double im[/*m*/]) const
+        {
+                for (int half = 1; half < m; half *= 2) {
+                        // the twiddles of this stage, contiguous
+                        double const* const stage_re = &w_re[half];
+                        double const* const stage_im = &w_im[half];
+                        for (int start = 0; start < m; start += 2 * half) {
+                                for (int k = 0; k < half; k++) {
+                                        double const wr = stage_re[k];
+                                        double const wi = stage_im[k];
+                                        int const a = start + k;
+                                        int const b = a + half;
+                                        double const t_re = re[b] * wr - im[b] * wi;
+                                        double const t_im = re[b] * wi + im[b] * wr;
+                                        re[b] = re[a] - t_re;
+                                        im[b] = im[a] - t_im;
+                                        re[a] += t_re;
+                                        im[a] += t_im;
+                                }
+                        }
+                }
+        }
+
+        int n;
+        int m;
+        std::vector<int> bit_reversed;
+        std::vector<double> w_re;
+        std::vector<double> w_im;
+        std::vector<double> real_w_re;
+        std::vector<double> real_w_im;
+        std::vector<double> z_re;
+        std::vector<double> z_im;
+};
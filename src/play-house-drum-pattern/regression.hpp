@@ -0,0 +1,168 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+/**
+ * What the regression suite remembers of a configuration of the
+ * renderer, between runs: the hash of its output and its speed.
+ *
+ * The output itself is kept alongside, as raw doubles, so that a
+ * changed hash can be told apart from a changed sound.
+ */
+struct RegressionBaseline {
+        enum {
+                MAX_NAME_SIZE = 32,
+                MAX_VOICE_N = 8,
+        };
+
+        char name[MAX_NAME_SIZE];
+        uint64_t hash;
+        double ns_per_sample;
+        int voice_n;
+        double voice_ns_per_sample[MAX_VOICE_N];
+};
+
+/// FNV-1a over the bits of the samples
+static uint64_t samples_hash(double const samples[/*n*/], int64_t const n)
+{
+        uint64_t hash = 0xcbf29ce484222325ULL;
+        for (int64_t i = 0; i < n; i++) {
+                uint64_t bits;
+                std::memcpy(&bits, &samples[i], sizeof bits);
+                for (int byte = 0; byte < 8; byte++) {
+                        hash ^= (bits >> (8 * byte)) & 0xff;
+                        hash *= 0x100000001b3ULL;
+                }
+        }
+        return hash;
+}
+
+struct SamplesDiff {
+        double max_diff;
+        /// of the first sample differing by more than the tolerance, or -1
+        int64_t first_index;
+        /// samples differing by more than the tolerance
+        int64_t over_n;
+};
+
+static SamplesDiff samples_diff(double const samples[/*n*/],
+                                double const expected[/*n*/],
+                                int64_t const n,
+                                double const tolerance)
+{
+        SamplesDiff diff = { 0.0, -1, 0 };
+        for (int64_t i = 0; i < n; i++) {
+                double const d = std::fabs(samples[i] - expected[i]);
+                // a NaN compares false, and must fail the check too
+                if (!(d <= tolerance)) {
+                        if (diff.first_index < 0) {
+                                diff.first_index = i;
+                        }
+                        diff.over_n++;
+                }
+                if (d > diff.max_diff || d != d) {
+                        diff.max_diff = d;
+                }
+        }
+        return diff;
+}
+
+/**
+ * Reads baselines written by save_regression_baselines.
+ *
+ * @returns the number read, 0 when the file does not exist
+ */
+static int load_regression_baselines(char const* path,
+                                     RegressionBaseline baselines[/*max_n*/],
+                                     int const max_n)
+{
+        FILE* file = std::fopen(path, "r");
+        if (!file) {
+                return 0;
+        }
+        int n = 0;
+        while (n < max_n) {
+                RegressionBaseline& baseline = baselines[n];
+                unsigned long long hash;
+                if (4 != std::fscanf(file, "%31s %llx %lf %d", baseline.name, &hash,
+                                     &baseline.ns_per_sample, &baseline.voice_n) ||
+                    baseline.voice_n < 0 ||
+                    baseline.voice_n > RegressionBaseline::MAX_VOICE_N) {
+                        break;
+                }
+                baseline.hash = hash;
+                int v = 0;
+                while (v < baseline.voice_n &&
+                       1 == std::fscanf(file, "%lf", &baseline.voice_ns_per_sample[v])) {
+                        v++;
+                }
+                if (v < baseline.voice_n) {
+                        break;
+                }
+                n++;
+        }
+        std::fclose(file);
+        return n;
+}
+
+/// one line per baseline: name, hash, ns/sample, voice count, voice ns/sample
+static bool save_regression_baselines(char const* path,
+                                      RegressionBaseline const baselines[/*n*/],
+                                      int const n)
+{
+        FILE* file = std::fopen(path, "w");
+        if (!file) {
+                return false;
+        }
+        for (int i = 0; i < n; i++) {
+                auto const& baseline = baselines[i];
+                std::fprintf(file, "%s %016llx %.3f %d", baseline.name,
+                             (unsigned long long) baseline.hash,
+                             baseline.ns_per_sample, baseline.voice_n);
+                for (int v = 0; v < baseline.voice_n; v++) {
+                        std::fprintf(file, " %.3f", baseline.voice_ns_per_sample[v]);
+                }
+                std::fprintf(file, "\n");
+        }
+        return 0 == std::fclose(file);
+}
+
+/// @returns the baseline named name, or nullptr
+static RegressionBaseline const* find_regression_baseline(RegressionBaseline const baselines[/*n*/],
+                                                          int const n,
+                                                          char const* name)
+{
+        for (int i = 0; i < n; i++) {
+                if (0 == std::strcmp(baselines[i].name, name)) {
+                        return &baselines[i];
+                }
+        }
+        return nullptr;
+}
+
+/// samples, as raw doubles in the machine's byte order
+static bool save_samples(char const* path, double const samples[/*n*/], int64_t const n)
+{
+        FILE* file = std::fopen(path, "wb");
+        if (!file) {
+                return false;
+        }
+        bool const written = size_t(n) == std::fwrite(samples, sizeof samples[0], n, file);
+        return 0 == std::fclose(file) && written;
+}
+
+/// @returns false unless exactly n samples could be read
+static bool load_samples(char const* path, double samples[/*n*/], int64_t const n)
+{
+        FILE* file = std::fopen(path, "rb");
+        if (!file) {
+                return false;
+        }
+        bool const read = size_t(n) == std::fread(samples, sizeof samples[0], n, file) &&
+                          std::fgetc(file) == EOF;
+        std::fclose(file);
+        return read;
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include "spsc_ring.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+/**
+ * Renders audio on a thread of its own, some time ahead of the audio
+ * device, which then only copies from a ring buffer.
+ *
+ * This adds the render-ahead time to the output latency, in exchange
+ * for absorbing the spikes of rendering time which would otherwise
+ * make the device callback miss its deadline.
+ */
+class RenderAhead
+{
+public:
+        typedef void (*RenderFn)(int sample_count,
+                                 double left[/*sample_count*/],
+                                 double right[/*sample_count*/]);
+
+        enum {
+                CAPACITY_FRAME_N = 1 << 15,
+                BLOCK_FRAME_N = 256,
+                IDLE_MICROS = 1000,
+        };
+
+        struct Telemetry {
+                int fill_frame_n;
+                /// lowest fill seen by the device since the last report
+                int min_fill_frame_n;
+                uint64_t underrun_n;
+                uint64_t underrun_frame_n;
+        };
+
+        ~RenderAhead()
+        {
+                stop();
+        }
+
+        /// starts rendering with fn, up to milliseconds ahead of the device
+        void start(RenderFn fn, double milliseconds)
+        {
+                int target = int(milliseconds * 48.0);
+                target = target < BLOCK_FRAME_N ? BLOCK_FRAME_N : target;
+                target = target > CAPACITY_FRAME_N ? CAPACITY_FRAME_N : target;
+
+                render_fn = fn;
+                target_frame_n = target;
+                quit.store(false);
+                thread = std::thread([this]() {
+                        render();
+                });
+        }
+
+        void stop()
+        {
+                if (thread.joinable()) {
+                        quit.store(true);
+                        thread.join();
+                }
+        }
+
+        bool is_running() const
+        {
+                return render_fn != nullptr;
+        }
+
+        int target_frames() const
+        {
+                return target_frame_n;
+        }
+
+        /// device side: never waits, and outputs silence when too late
+        void read(int const sample_count,
+                  double left[/*sample_count*/],
+                  double right[/*sample_count*/])
+        {
+                int fill = int(frames.size());
+                int min_fill = min_fill_frame_n.load(std::memory_order_relaxed);
+                while (fill < min_fill &&
+                       !min_fill_frame_n.compare_exchange_weak(min_fill, fill)) {
+                }
+
+                Frame block[BLOCK_FRAME_N];
+                int missing_n = 0;
+                for (int i = 0; i < sample_count; i += BLOCK_FRAME_N) {
+                        int const n = sample_count - i < BLOCK_FRAME_N ?
+                                      sample_count - i : BLOCK_FRAME_N;
+                        int const popped = int(frames.pop_n(block, n));
+                        for (int j = 0; j < popped; j++) {
+                                left[i + j] = block[j].left;
+                                right[i + j] = block[j].right;
+                        }
+                        for (int j = popped; j < n; j++) {
+                                left[i + j] = 0.0;
+                                right[i + j] = 0.0;
+                        }
+                        missing_n += n - popped;
+                }
+
+                if (missing_n > 0) {
+                        underrun_n.fetch_add(1, std::memory_order_relaxed);
+                        underrun_frame_n.fetch_add(missing_n, std::memory_order_relaxed);
+                }
+        }
+
+        /// from any thread, restarting the minimum fill level
+        Telemetry telemetry()
+        {
+                Telemetry result;
+                result.fill_frame_n = int(frames.size());
+                result.min_fill_frame_n = min_fill_frame_n.exchange(CAPACITY_FRAME_N);
+                result.underrun_n = underrun_n.load(std::memory_order_relaxed);
+                result.underrun_frame_n = underrun_frame_n.load(std::memory_order_relaxed);
+                return result;
+        }
+
+private:
+        struct Frame {
+                double left;
+                double right;
+        };
+
+        void render()
+        {
+                double left[BLOCK_FRAME_N];
+                double right[BLOCK_FRAME_N];
+                Frame block[BLOCK_FRAME_N];
+                while (!quit.load(std::memory_order_relaxed)) {
+                        if (int(frames.size()) + BLOCK_FRAME_N > target_frame_n) {
+                                std::this_thread::sleep_for(std::chrono::microseconds(IDLE_MICROS));
+                                continue;
+                        }
+                        render_fn(BLOCK_FRAME_N, left, right);
+                        for (int i = 0; i < BLOCK_FRAME_N; i++) {
+                                block[i].left = left[i];
+                                block[i].right = right[i];
+                        }
+                        // always fits, as we are the only producer
+                        frames.push_n(block, BLOCK_FRAME_N);
+                }
+        }
+
+        RenderFn render_fn = nullptr;
+        int target_frame_n = 0;
+        std::thread thread;
+        std::atomic<bool> quit { false };
+
+        SpscRing<Frame, CAPACITY_FRAME_N> frames;
+
+        std::atomic<int> min_fill_frame_n { CAPACITY_FRAME_N };
+        std::atomic<uint64_t> underrun_n { 0 };
+        std::atomic<uint64_t> underrun_frame_n { 0 };
+};
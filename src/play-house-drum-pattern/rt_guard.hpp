@@ -0,0 +1,469 @@
+#pragma once
+
+/**
+ * Reports what must never happen while rendering audio: allocating,
+ * locking a mutex, signaling a condition or a semaphore, sleeping,
+ * changing the scheduling or making system calls.
+ *
+ * Rendering code declares an RtGuardScope. When built with
+ * QNTRX_RT_GUARD defined, the guarded functions are interposed, and
+ * calling one within a scope reports it to stderr with a stack trace.
+ * Otherwise scopes compile to nothing.
+ *
+ * The stack traces are raw addresses for static functions, which
+ * addr2line -f -C -e <executable> turns into names. Linking with
+ * -rdynamic names the others.
+ *
+ * Only for glibc, where the functions are interposed by defining them
+ * and reaching the real ones through dlsym(RTLD_NEXT, ...). Only
+ * calls from outside libc itself are seen: its own futex waits inside
+ * pthread_* are reported through their entry points, and a direct
+ * syscall(SYS_futex, ...) through syscall.
+ *
+ * play-house-drum-pattern-rt-guard.sh builds and runs the program in
+ * this mode, which --offline renders check.
+ */
+
+#include <cstdint>
+
+#if defined(QNTRX_RT_GUARD)
+
+#include <atomic>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdio>
+
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+enum {
+        /// violations reported with their stack; the others are counted
+        RT_GUARD_MAX_REPORT_N = 16,
+        RT_GUARD_MAX_FRAME_N = 32,
+        /// serves allocations made by dlsym while resolving
+        RT_GUARD_BOOTSTRAP_SIZE = 4096,
+};
+
+/// depth of guarded scopes on this thread
+static thread_local int rt_guard_depth = 0;
+/// set while reporting, which itself calls guarded functions
+static thread_local bool rt_guard_reporting = false;
+static std::atomic<uint64_t> rt_guard_violation_n { 0 };
+
+static struct RtGuardReal {
+        void* (*malloc)(size_t);
+        void* (*calloc)(size_t, size_t);
+        void* (*realloc)(void*, size_t);
+        void (*free)(void*);
+        int (*posix_memalign)(void**, size_t, size_t);
+        void* (*aligned_alloc)(size_t, size_t);
+        int (*pthread_mutex_lock)(pthread_mutex_t*);
+        int (*pthread_mutex_trylock)(pthread_mutex_t*);
+        int (*pthread_mutex_unlock)(pthread_mutex_t*);
+        int (*pthread_cond_wait)(pthread_cond_t*, pthread_mutex_t*);
+        int (*pthread_cond_timedwait)(pthread_cond_t*, pthread_mutex_t*, struct timespec const*);
+        int (*pthread_cond_signal)(pthread_cond_t*);
+        int (*pthread_cond_broadcast)(pthread_cond_t*);
+        int (*sem_wait)(sem_t*);
+        int (*sem_timedwait)(sem_t*, struct timespec const*);
+        int (*sem_post)(sem_t*);
+        long (*syscall)(long, ...);
+        ssize_t (*read)(int, void*, size_t);
+        ssize_t (*write)(int, void const*, size_t);
+        int (*close)(int);
+        void* (*mmap)(void*, size_t, int, int, int, off_t);
+        int (*munmap)(void*, size_t);
+        int (*nanosleep)(struct timespec const*, struct timespec*);
+        int (*clock_nanosleep)(clockid_t, int, struct timespec const*, struct timespec*);
+        int (*usleep)(useconds_t);
+        int (*sched_yield)();
+        int (*sched_setscheduler)(pid_t, int, struct sched_param const*);
+        int (*sched_setparam)(pid_t, struct sched_param const*);
+        int (*pthread_setschedparam)(pthread_t, int, struct sched_param const*);
+
+        bool resolved;
+        bool resolving;
+        unsigned char bootstrap[RT_GUARD_BOOTSTRAP_SIZE];
+        size_t bootstrap_used;
+} rt_guard_real;
+
+template <typename Fn>
+static void rt_guard_resolve_one(Fn*& fn, char const* name)
+{
+        fn = reinterpret_cast<Fn*>(dlsym(RTLD_NEXT, name));
+}
+
+/**
+ * Resolves the version of name that programs link to today: dlsym
+ * returns the oldest, which for the pthread_cond_* functions of x86-64
+ * is a compatibility shim for another layout of pthread_cond_t.
+ */
+template <typename Fn>
+static void rt_guard_resolve_versioned(Fn*& fn, char const* name, char const* version)
+{
+        fn = reinterpret_cast<Fn*>(dlvsym(RTLD_NEXT, name, version));
+        if (!fn) {
+                // architectures with a single version of it
+                rt_guard_resolve_one(fn, name);
+        }
+}
+
+static void rt_guard_resolve()
+{
+        auto& real = rt_guard_real;
+        if (real.resolved || real.resolving) {
+                return;
+        }
+        real.resolving = true;
+        rt_guard_resolve_one(real.malloc, "malloc");
+        rt_guard_resolve_one(real.calloc, "calloc");
+        rt_guard_resolve_one(real.realloc, "realloc");
+        rt_guard_resolve_one(real.free, "free");
+        rt_guard_resolve_one(real.posix_memalign, "posix_memalign");
+        rt_guard_resolve_one(real.aligned_alloc, "aligned_alloc");
+        rt_guard_resolve_one(real.pthread_mutex_lock, "pthread_mutex_lock");
+        rt_guard_resolve_one(real.pthread_mutex_trylock, "pthread_mutex_trylock");
+        rt_guard_resolve_one(real.pthread_mutex_unlock, "pthread_mutex_unlock");
+        rt_guard_resolve_versioned(real.pthread_cond_wait, "pthread_cond_wait", "GLIBC_2.3.2");
+        rt_guard_resolve_versioned(real.pthread_cond_timedwait, "pthread_cond_timedwait",
+                                   "GLIBC_2.3.2");
+        rt_guard_resolve_versioned(real.pthread_cond_signal, "pthread_cond_signal",
+                                   "GLIBC_2.3.2");
+        rt_guard_resolve_versioned(real.pthread_cond_broadcast, "pthread_cond_broadcast",
+                                   "GLIBC_2.3.2");
+        rt_guard_resolve_one(real.sem_wait, "sem_wait");
+        rt_guard_resolve_one(real.sem_timedwait, "sem_timedwait");
+        rt_guard_resolve_one(real.sem_post, "sem_post");
+        rt_guard_resolve_one(real.syscall, "syscall");
+        rt_guard_resolve_one(real.read, "read");
+        rt_guard_resolve_one(real.write, "write");
+        rt_guard_resolve_one(real.close, "close");
+        rt_guard_resolve_one(real.mmap, "mmap");
+        rt_guard_resolve_one(real.munmap, "munmap");
+        rt_guard_resolve_one(real.nanosleep, "nanosleep");
+        rt_guard_resolve_one(real.clock_nanosleep, "clock_nanosleep");
+        rt_guard_resolve_one(real.usleep, "usleep");
+        rt_guard_resolve_one(real.sched_yield, "sched_yield");
+        rt_guard_resolve_one(real.sched_setscheduler, "sched_setscheduler");
+        rt_guard_resolve_one(real.sched_setparam, "sched_setparam");
+        rt_guard_resolve_one(real.pthread_setschedparam, "pthread_setschedparam");
+        real.resolving = false;
+        real.resolved = true;
+}
+
+static bool rt_guard_is_bootstrap(void const* ptr)
+{
+        auto const* const bytes = static_cast<unsigned char const*>(ptr);
+        return bytes >= rt_guard_real.bootstrap &&
+               bytes < rt_guard_real.bootstrap + RT_GUARD_BOOTSTRAP_SIZE;
+}
+
+static void* rt_guard_bootstrap_alloc(size_t const size)
+{
+        auto& real = rt_guard_real;
+        size_t const start = (real.bootstrap_used + 15) & ~size_t(15);
+        if (start + size > RT_GUARD_BOOTSTRAP_SIZE) {
+                return nullptr;
+        }
+        real.bootstrap_used = start + size;
+        return &real.bootstrap[start];
+}
+
+static void rt_guard_violation(char const* what)
+{
+        if (rt_guard_depth == 0 || rt_guard_reporting) {
+                return;
+        }
+        rt_guard_reporting = true;
+        uint64_t const n = rt_guard_violation_n.fetch_add(1);
+        if (n < RT_GUARD_MAX_REPORT_N) {
+                char line[128];
+                int const size = snprintf(line, sizeof line,
+                                          "rt guard: %s while rendering audio\n", what);
+                rt_guard_real.write(STDERR_FILENO, line, size_t(size));
+                void* frames[RT_GUARD_MAX_FRAME_N];
+                int const frame_n = backtrace(frames, RT_GUARD_MAX_FRAME_N);
+                backtrace_symbols_fd(frames, frame_n, STDERR_FILENO);
+        } else if (n == RT_GUARD_MAX_REPORT_N) {
+                char const line[] = "rt guard: further violations are only counted\n";
+                rt_guard_real.write(STDERR_FILENO, line, sizeof line - 1);
+        }
+        rt_guard_reporting = false;
+}
+
+/// loads what backtrace() loads on its first use, outside of any scope
+static struct RtGuardInit {
+        RtGuardInit()
+        {
+                rt_guard_resolve();
+                void* frame;
+                backtrace(&frame, 1);
+        }
+} rt_guard_init;
+
+extern "C" {
+
+void* malloc(size_t size) noexcept
+{
+        rt_guard_resolve();
+        if (!rt_guard_real.malloc) {
+                return rt_guard_bootstrap_alloc(size);
+        }
+        rt_guard_violation("malloc");
+        return rt_guard_real.malloc(size);
+}
+
+void* calloc(size_t n, size_t size) noexcept
+{
+        rt_guard_resolve();
+        if (!rt_guard_real.calloc) {
+                // zeroed already, being static storage used only once
+                return rt_guard_bootstrap_alloc(n * size);
+        }
+        rt_guard_violation("calloc");
+        return rt_guard_real.calloc(n, size);
+}
+
+void* realloc(void* ptr, size_t size) noexcept
+{
+        rt_guard_resolve();
+        rt_guard_violation("realloc");
+        return rt_guard_real.realloc(ptr, size);
+}
+
+void free(void* ptr) noexcept
+{
+        if (!ptr || rt_guard_is_bootstrap(ptr)) {
+                return;
+        }
+        rt_guard_violation("free");
+        rt_guard_real.free(ptr);
+}
+
+int posix_memalign(void** ptr, size_t alignment, size_t size) noexcept
+{
+        rt_guard_resolve();
+        rt_guard_violation("posix_memalign");
+        return rt_guard_real.posix_memalign(ptr, alignment, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size) noexcept
+{
+        rt_guard_resolve();
+        rt_guard_violation("aligned_alloc");
+        return rt_guard_real.aligned_alloc(alignment, size);
+}
+
+int pthread_mutex_lock(pthread_mutex_t* mutex) noexcept
+{
+        rt_guard_resolve();
+        rt_guard_violation("pthread_mutex_lock");
+        return rt_guard_real.pthread_mutex_lock(mutex);
+}
+
+int pthread_mutex_trylock(pthread_mutex_t* mutex) noexcept
+{
+        rt_guard_resolve();
+        rt_guard_violation("pthread_mutex_trylock");
+        return rt_guard_real.pthread_mutex_trylock(mutex);
+}
+
+int pthread_mutex_unlock(pthread_mutex_t* mutex) noexcept
+{
+        rt_guard_resolve();
+        rt_guard_violation("pthread_mutex_unlock");
+        return rt_guard_real.pthread_mutex_unlock(mutex);
+}
+
+int pthread_cond_wait(pthread_cond_t* cond, pthread_mutex_t* mutex)
+{
+        rt_guard_resolve();
+        rt_guard_violation("pthread_cond_wait");
+        return rt_guard_real.pthread_cond_wait(cond, mutex);
+}
+
+int pthread_cond_timedwait(pthread_cond_t* cond, pthread_mutex_t* mutex,
+                           struct timespec const* time)
+{
+        rt_guard_resolve();
+        rt_guard_violation("pthread_cond_timedwait");
+        return rt_guard_real.pthread_cond_timedwait(cond, mutex, time);
+}
+
+int pthread_cond_signal(pthread_cond_t* cond) noexcept
+{
+        rt_guard_resolve();
+        rt_guard_violation("pthread_cond_signal");
+        return rt_guard_real.pthread_cond_signal(cond);
+}
+
+int pthread_cond_broadcast(pthread_cond_t* cond) noexcept
+{
+        rt_guard_resolve();
+        rt_guard_violation("pthread_cond_broadcast");
+        return rt_guard_real.pthread_cond_broadcast(cond);
+}
+
+int sem_wait(sem_t* semaphore)
+{
+        rt_guard_resolve();
+        rt_guard_violation("sem_wait");
+        return rt_guard_real.sem_wait(semaphore);
+}
+
+int sem_timedwait(sem_t* semaphore, struct timespec const* time)
+{
+        rt_guard_resolve();
+        rt_guard_violation("sem_timedwait");
+        return rt_guard_real.sem_timedwait(semaphore, time);
+}
+
+int sem_post(sem_t* semaphore) noexcept
+{
+        rt_guard_resolve();
+        rt_guard_violation("sem_post");
+        return rt_guard_real.sem_post(semaphore);
+}
+
+/// such as the futex waits and wakes that libc does not wrap
+long syscall(long number, ...) noexcept
+{
+        // system calls take up to 6 register sized arguments, which
+        // the calling conventions of glibc's targets let us pass on
+        // even when fewer were given
+        long arguments[6];
+        va_list list;
+        va_start(list, number);
+        for (auto& argument : arguments) {
+                argument = va_arg(list, long);
+        }
+        va_end(list);
+        rt_guard_resolve();
+        rt_guard_violation("syscall");
+        return rt_guard_real.syscall(number, arguments[0], arguments[1], arguments[2],
+                                     arguments[3], arguments[4], arguments[5]);
+}
+
+ssize_t read(int fd, void* buffer, size_t size)
+{
+        rt_guard_resolve();
+        rt_guard_violation("read");
+        return rt_guard_real.read(fd, buffer, size);
+}
+
+ssize_t write(int fd, void const* buffer, size_t size)
+{
+        rt_guard_resolve();
+        rt_guard_violation("write");
+        return rt_guard_real.write(fd, buffer, size);
+}
+
+int close(int fd)
+{
+        rt_guard_resolve();
+        rt_guard_violation("close");
+        return rt_guard_real.close(fd);
+}
+
+void* mmap(void* address, size_t size, int protection, int flags, int fd, off_t offset) noexcept
+{
+        rt_guard_resolve();
+        rt_guard_violation("mmap");
+        return rt_guard_real.mmap(address, size, protection, flags, fd, offset);
+}
+
+int munmap(void* address, size_t size) noexcept
+{
+        rt_guard_resolve();
+        rt_guard_violation("munmap");
+        return rt_guard_real.munmap(address, size);
+}
+
+int nanosleep(struct timespec const* duration, struct timespec* remaining)
+{
+        rt_guard_resolve();
+        rt_guard_violation("nanosleep");
+        return rt_guard_real.nanosleep(duration, remaining);
+}
+
+int clock_nanosleep(clockid_t clock, int flags,
+                    struct timespec const* time, struct timespec* remaining)
+{
+        rt_guard_resolve();
+        rt_guard_violation("clock_nanosleep");
+        return rt_guard_real.clock_nanosleep(clock, flags, time, remaining);
+}
+
+int usleep(useconds_t micros)
+{
+        rt_guard_resolve();
+        rt_guard_violation("usleep");
+        return rt_guard_real.usleep(micros);
+}
+
+int sched_yield() noexcept
+{
+        rt_guard_resolve();
+        rt_guard_violation("sched_yield");
+        return rt_guard_real.sched_yield();
+}
+
+int sched_setscheduler(pid_t pid, int policy, struct sched_param const* param) noexcept
+{
+        rt_guard_resolve();
+        rt_guard_violation("sched_setscheduler");
+        return rt_guard_real.sched_setscheduler(pid, policy, param);
+}
+
+int sched_setparam(pid_t pid, struct sched_param const* param) noexcept
+{
+        rt_guard_resolve();
+        rt_guard_violation("sched_setparam");
+        return rt_guard_real.sched_setparam(pid, param);
+}
+
+int pthread_setschedparam(pthread_t thread, int policy, struct sched_param const* param) noexcept
+{
+        rt_guard_resolve();
+        rt_guard_violation("pthread_setschedparam");
+        return rt_guard_real.pthread_setschedparam(thread, policy, param);
+}
+
+}
+
+/// marks the code running during its lifetime as rendering audio
+struct RtGuardScope {
+        RtGuardScope()
+        {
+                rt_guard_depth++;
+        }
+        ~RtGuardScope()
+        {
+                rt_guard_depth--;
+        }
+};
+
+/// @returns the violations seen so far, on all threads
+static uint64_t rt_guard_violations()
+{
+        return rt_guard_violation_n.load();
+}
+
+#else
+
+struct RtGuardScope {
+        RtGuardScope() {}
+};
+
+static inline uint64_t rt_guard_violations()
+{
+        return 0;
+}
+
+#endif
@@ -0,0 +1,265 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+/**
+ * A cycle of steps, such as the sixteen steps of a measure, and the
+ * notes played on them.
+ *
+ * A note of length L plays the phase of a grid of L steps: it goes
+ * from 0 to 1 over the note when the note starts on that grid, and
+ * starts half-way through when, for instance, a two-step note starts
+ * on an odd step. Notes sounding together add their phases, modulo 1.
+ */
+struct Pattern {
+        enum {
+                MAX_STEP_N = 64,
+                MAX_EVENT_N = 32,
+        };
+
+        struct Event {
+                int step;
+                int length;
+                double velocity;
+        };
+
+        int step_n = 0;
+        int event_n = 0;
+        Event events[MAX_EVENT_N];
+
+        /**
+         * Reads lanes of steps separated by '|', all of the same length,
+         * as in "..x...x.|.....x-.".
+         *
+         * In a lane '.' is a rest, 'x' a note at full velocity, '1' to
+         * '9' a note at a ninth of that velocity, and '-' extends the
+         * previous note by a step.
+         *
+         * @returns false and leaves the pattern unchanged on errors
+         */
+        bool parse(char const* lanes)
+        {
+                Pattern pattern;
+                int lane_step_n = 0;
+                Event* note = nullptr;
+                for (char const* c = lanes;; c++) {
+                        if (*c == '|' || *c == '\0') {
+                                if (pattern.step_n == 0) {
+                                        pattern.step_n = lane_step_n;
+                                }
+                                if (lane_step_n != pattern.step_n) {
+                                        return false;
+                                }
+                                if (*c == '\0') {
+                                        break;
+                                }
+                                lane_step_n = 0;
+                                note = nullptr;
+                                continue;
+                        }
+
+                        if (lane_step_n == MAX_STEP_N) {
+                                return false;
+                        }
+                        int const step = lane_step_n++;
+                        if (*c == '.') {
+                                note = nullptr;
+                        } else if (*c == '-') {
+                                if (!note) {
+                                        return false;
+                                }
+                                note->length++;
+                        } else if (*c == 'x' || (*c >= '1' && *c <= '9')) {
+                                if (pattern.event_n == MAX_EVENT_N) {
+                                        return false;
+                                }
+                                note = &pattern.events[pattern.event_n++];
+                                note->step = step;
+                                note->length = 1;
+                                note->velocity = *c == 'x' ? 1.0 : (*c - '0') / 9.0;
+                        } else {
+                                return false;
+                        }
+                }
+                if (pattern.step_n == 0) {
+                        return false;
+                }
+                *this = pattern;
+                return true;
+        }
+
+        /// @returns true when event sounds during step
+        bool is_active(Event const& event, int step) const
+        {
+                return (step - event.step + step_n) % step_n < event.length;
+        }
+
+        /// @returns the velocity of the last note started at or before step
+        double held_velocity(int step) const
+        {
+                double velocity = 1.0;
+                int age = step_n;
+                for (int i = 0; i < event_n; i++) {
+                        int const event_age = (step - events[i].step + step_n) % step_n;
+                        if (event_age < age) {
+                                age = event_age;
+                                velocity = events[i].velocity;
+                        }
+                }
+                return velocity;
+        }
+};
+
+/// a run of samples within the same step of a pattern
+struct PatternSegment {
+        int start;
+        int end;
+        int step;
+};
+
+/**
+ * Splits a block into the steps of pattern it crosses.
+ *
+ * Only the step at the start of the block and the samples where the
+ * next steps start are computed, from the increment of the cycle, so
+ * the cost does not depend on the block length. The estimates are
+ * checked against cycle_phases so that steps change exactly on the
+ * samples where floor(phase * step_n) does.
+ *
+ * @param cycle_phases phases of the pattern's cycle for the block
+ * @param increment the cycle's increment during the block
+ * @returns the number of segments written to segments, which stop
+ * short of sample_count when the block crosses more than max_segment_n
+ * steps
+ */
+static int pattern_segments(Pattern const& pattern,
+                            double const cycle_phases[/*sample_count*/],
+                            double const increment,
+                            int const sample_count,
+                            PatternSegment segments[/*max_segment_n*/],
+                            int const max_segment_n)
+{
+        double const step_n = pattern.step_n;
+        auto step_at = [&](int i) {
+                return int(std::floor(cycle_phases[i] * step_n));
+        };
+
+        int segment_n = 0;
+        int start = 0;
+        while (start < sample_count && segment_n < max_segment_n) {
+                int const step = step_at(start);
+                double const step_end_phase = (step + 1) / step_n;
+                double const estimate = increment > 0.0 ?
+                                        std::ceil((step_end_phase - cycle_phases[start]) / increment) :
+                                        sample_count;
+                int end = estimate < double(sample_count - start) ?
+                          start + std::max(1, int(estimate)) : sample_count;
+                while (end > start + 1 && step_at(end - 1) != step) {
+                        end--;
+                }
+                while (end < sample_count && step_at(end) == step) {
+                        end++;
+                }
+
+                PatternSegment& segment = segments[segment_n++];
+                segment.start = start;
+                segment.end = end;
+                segment.step = step;
+                start = end;
+        }
+        return segment_n;
+}
+
+/// plays pattern over the samples of segments, see render_pattern
+static void render_pattern_segments(Pattern const& pattern,
+                                    double const cycle_phases[/*sample_count*/],
+                                    PatternSegment const segments[/*segment_n*/],
+                                    int const segment_n,
+                                    double note_phases[/*sample_count*/],
+                                    double velocities[/*sample_count*/],
+                                    bool gates[/*sample_count*/])
+{
+        for (int s = 0; s < segment_n; s++) {
+                auto const& segment = segments[s];
+                int const n = segment.end - segment.start;
+
+                // grids of the notes sounding, and the index of their
+                // current cell, which stays the same until the step ends
+                double grids[Pattern::MAX_EVENT_N];
+                double cells[Pattern::MAX_EVENT_N];
+                int grid_n = 0;
+                for (int e = 0; e < pattern.event_n; e++) {
+                        auto const& event = pattern.events[e];
+                        if (pattern.is_active(event, segment.step)) {
+                                grids[grid_n] = double(pattern.step_n) / event.length;
+                                cells[grid_n] = std::floor(cycle_phases[segment.start] *
+                                                           grids[grid_n]);
+                                grid_n++;
+                        }
+                }
+
+                double* const phases = note_phases ? &note_phases[segment.start] : nullptr;
+                double const* const cycle = &cycle_phases[segment.start];
+                if (!phases) {
+                        // only gates or velocities wanted
+                } else if (grid_n == 0) {
+                        std::fill_n(phases, n, 0.0);
+                } else if (grid_n == 1) {
+                        for (int i = 0; i < n; i++) {
+                                phases[i] = cycle[i] * grids[0] - cells[0];
+                        }
+                } else {
+                        for (int i = 0; i < n; i++) {
+                                double phase = 0.0;
+                                for (int g = 0; g < grid_n; g++) {
+                                        phase += cycle[i] * grids[g] - cells[g];
+                                }
+                                phases[i] = std::fmod(phase, 1.0);
+                        }
+                }
+
+                if (velocities) {
+                        std::fill_n(&velocities[segment.start], n,
+                                    pattern.held_velocity(segment.step));
+                }
+                if (gates) {
+                        std::fill_n(&gates[segment.start], n, grid_n > 0);
+                }
+        }
+}
+
+/**
+ * Plays pattern over a block.
+ *
+ * @param note_phases receives the phase of the notes sounding, 0 when
+ * none do, optional
+ * @param velocities receives the held velocity, optional
+ * @param gates receives whether a note sounds, optional
+ */
+static void render_pattern(Pattern const& pattern,
+                           double const cycle_phases[/*sample_count*/],
+                           double const increment,
+                           int const sample_count,
+                           double note_phases[/*sample_count*/],
+                           double velocities[/*sample_count*/],
+                           bool gates[/*sample_count*/])
+{
+        enum {
+                MAX_SEGMENT_N = 64,
+        };
+        PatternSegment segments[MAX_SEGMENT_N];
+        // blocks crossing more steps than fit in segments take several passes
+        for (int pass_start = 0; pass_start < sample_count;) {
+                int const segment_n = pattern_segments(pattern, &cycle_phases[pass_start],
+                                                       increment, sample_count - pass_start,
+                                                       segments, MAX_SEGMENT_N);
+                for (int s = 0; s < segment_n; s++) {
+                        segments[s].start += pass_start;
+                        segments[s].end += pass_start;
+                }
+                pass_start = segments[segment_n - 1].end;
+                render_pattern_segments(pattern, cycle_phases, segments, segment_n,
+                                        note_phases, velocities, gates);
+        }
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+/**
+ * A bounded queue between exactly one producer thread and one consumer
+ * thread, neither of which ever locks nor allocates.
+ *
+ * @param N capacity, a power of two
+ */
+template <typename T, size_t N>
+class SpscRing
+{
+public:
+        static_assert(N > 0 && (N & (N - 1)) == 0, "N must be a power of two");
+
+        /// producer side, @returns false when the ring is full
+        bool push(T const& value)
+        {
+                size_t const write = write_index.load(std::memory_order_relaxed);
+                if (write - read_index.load(std::memory_order_acquire) == N) {
+                        return false;
+                }
+                items[write % N] = value;
+                write_index.store(write + 1, std::memory_order_release);
+                return true;
+        }
+
+        /// consumer side, @returns false when the ring is empty
+        bool pop(T* value)
+        {
+                size_t const read = read_index.load(std::memory_order_relaxed);
+                if (write_index.load(std::memory_order_acquire) == read) {
+                        return false;
+                }
+                *value = items[read % N];
+                read_index.store(read + 1, std::memory_order_release);
+                return true;
+        }
+
+        /// producer side, @returns how many of the n values were pushed
+        size_t push_n(T const values[], size_t n)
+        {
+                size_t const write = write_index.load(std::memory_order_relaxed);
+                size_t const room = N - (write - read_index.load(std::memory_order_acquire));
+                size_t const count = n < room ? n : room;
+                for (size_t i = 0; i < count; i++) {
+                        items[(write + i) % N] = values[i];
+                }
+                write_index.store(write + count, std::memory_order_release);
+                return count;
+        }
+
+        /// consumer side, @returns how many of the n values were popped
+        size_t pop_n(T values[], size_t n)
+        {
+                size_t const read = read_index.load(std::memory_order_relaxed);
+                size_t const available = write_index.load(std::memory_order_acquire) - read;
+                size_t const count = n < available ? n : available;
+                for (size_t i = 0; i < count; i++) {
+                        values[i] = items[(read + i) % N];
+                }
+                read_index.store(read + count, std::memory_order_release);
+                return count;
+        }
+
+        /// an estimate when called from neither side
+        size_t size() const
+        {
+                return write_index.load(std::memory_order_acquire) -
+                       read_index.load(std::memory_order_acquire);
+        }
+
+private:
+        // on their own cache lines, as each is written by another thread
+        alignas(64) std::atomic<size_t> write_index { 0 };
+        alignas(64) std::atomic<size_t> read_index { 0 };
+        alignas(64) T items[N];
+};
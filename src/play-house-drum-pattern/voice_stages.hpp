@@ -0,0 +1,204 @@
+#pragma once
+
+#include "envelopes.hpp"
+#include "phasers.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+/**
+ * The stages the drum voices are built from, over blocks of n samples.
+ *
+ * Params is either a struct of runtime parameters or a preset whose
+ * parameters are static constexpr members. Both read as params.name,
+ * so the same stage compiles into a version reading the parameters
+ * from memory or one with the constants folded in.
+ *
+ * Math is one of the math policies, as used by the voices.
+ *
+ * Params may also be a struct of ParamRamp, for the blocks where the
+ * parameters move: stages read them with param_at at every sample.
+ *
+ * Envelopes are evaluated every control_period samples and
+ * interpolated in between, see control_rate_sinexpenv_block.
+ */
+
+/**
+ * A parameter over a block of n samples, going linearly from its value
+ * before the block to its value at the end.
+ *
+ * A parameter which does not change is exactly the same at every sample.
+ */
+struct ParamRamp {
+        double from;
+        double step;
+
+        double at(int const i) const
+        {
+                return from + step * (i + 1);
+        }
+
+        /// the highest absolute value over the block
+        double bound(int const n) const
+        {
+                return std::max(std::fabs(from), std::fabs(at(n - 1)));
+        }
+};
+
+/// a parameter constant over the block, from memory or a preset
+static inline double param_at(double const value, int)
+{
+        return value;
+}
+
+static inline double param_at(ParamRamp const& ramp, int const i)
+{
+        return ramp.at(i);
+}
+
+/// an envelope with constant parameters, see control_rate_sinexpenv_block
+template <typename Math>
+static void envelope_block(double const phases[/*n*/], int const n,
+                           double const attack_speed, double const decay_speed,
+                           int const control_period, double out[/*n*/])
+{
+        control_rate_sinexpenv_block<Math>(phases, n, attack_speed, decay_speed,
+                                           control_period, out);
+}
+
+/**
+ * An envelope whose parameters ramp, evaluated at every sample with
+ * their values there. Only for the few blocks of a parameter change,
+ * so neither the control period nor the recurrence of
+ * IncrementalEnvelopes, which needs constant parameters, are used.
+ */
+template <typename Math>
+static void envelope_block(double const phases[/*n*/], int const n,
+                           ParamRamp const attack_speed, ParamRamp const decay_speed,
+                           int, double out[/*n*/])
+{
+        for (int i = 0; i < n; i++) {
+                Math::sinexpenv_block(&phases[i], 1, attack_speed.at(i), decay_speed.at(i),
+                                      &out[i]);
+        }
+}
+
+/// the state of an oscillator, carried from one block to the next
+struct OscillatorState {
+        double phase;
+        double increment;
+};
+
+/// the amplitude envelope of notes
+template <typename Math, typename Params>
+static void amplitude_envelope_stage(Params const& params,
+                                     double const note_phases[/*n*/],
+                                     int const n,
+                                     int const control_period,
+                                     double amplitudes[/*n*/])
+{
+        envelope_block<Math>(note_phases, n,
+                             params.amplitude_env_accel,
+                             params.amplitude_env_decay,
+                             control_period, amplitudes);
+}
+
+/// a frequency swept down from freq_env_base + freq_env_amp by an envelope
+template <typename Math, typename Params>
+static void swept_frequency_stage(Params const& params,
+                                  double const note_phases[/*n*/],
+                                  int const n,
+                                  int const control_period,
+                                  double frequencies[/*n*/])
+{
+        envelope_block<Math>(note_phases, n,
+                             params.freq_env_accel,
+                             params.freq_env_decay,
+                             control_period, frequencies);
+        for (int i = 0; i < n; i++) {
+                frequencies[i] = param_at(params.freq_env_base, i) +
+                                 param_at(params.freq_env_amp, i) * frequencies[i];
+        }
+}
+
+/// an oscillator which only follows frequencies while its gate is open
+static void gated_oscillator_stage(double const frequencies[/*n*/],
+                                   bool const gates[/*n*/],
+                                   int const n,
+                                   OscillatorState& osc,
+                                   double phases[/*n*/],
+                                   double increments[/*n*/])
+{
+        double phase = osc.phase;
+        double increment = osc.increment;
+        for (int i = 0; i < n; i++) {
+                if (gates[i]) {
+                        increment = Phasers::to_increment(frequencies[i]);
+                }
+                phases[i] = phase;
+                increments[i] = increment;
+                phase = phaser_wrap(phase + increment);
+        }
+        osc.phase = phase;
+        osc.increment = increment;
+}
+
+/// an oscillator following another's increments at some ratio
+static void follower_oscillator_stage(double const main_increments[/*n*/],
+                                      double const ratio,
+                                      int const n,
+                                      double& phase,
+                                      double phases[/*n*/])
+{
+        double p = phase;
+        for (int i = 0; i < n; i++) {
+                phases[i] = p;
+                p = phaser_wrap(p + phaser_wrap_increment(main_increments[i] * ratio));
+        }
+        phase = p;
+}
+
+/**
+ * An oscillator modulated in frequency by a modulator, itself modulated
+ * by the oscillator's output.
+ *
+ * @param sines receives the oscillator's sine at every phase
+ */
+template <typename Math, typename Params>
+static void feedback_fm_stage(Params const& params,
+                              double const frequencies[/*n*/],
+                              int const n,
+                              OscillatorState& osc,
+                              OscillatorState& modulator,
+                              double phases[/*n*/],
+                              double sines[/*n*/])
+{
+        double osc_phase = osc.phase;
+        double osc_increment = osc.increment;
+        double mod_phase = modulator.phase;
+        double mod_increment = modulator.increment;
+
+        for (int i = 0; i < n; i++) {
+                double const freq = frequencies[i];
+
+                double const osc_sine = Math::sin_turns(osc_phase);
+                double const modulation = param_at(params.modulator_index, i) *
+                                          Math::sin_turns(mod_phase);
+                double const main_freq = freq + modulation;
+
+                mod_increment = Phasers::to_increment(param_at(params.feedback, i) * osc_sine +
+                                                      freq / param_at(params.modulator_freq_ratio, i));
+                osc_increment = Phasers::to_increment(main_freq);
+
+                phases[i] = osc_phase;
+                sines[i] = osc_sine;
+
+                osc_phase = phaser_wrap(osc_phase + osc_increment);
+                mod_phase = phaser_wrap(mod_phase + mod_increment);
+        }
+
+        osc.phase = osc_phase;
+        osc.increment = osc_increment;
+        modulator.phase = mod_phase;
+        modulator.increment = mod_increment;
+}
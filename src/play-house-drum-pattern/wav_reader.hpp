@@ -0,0 +1,210 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * A WAV file mapped in memory, its samples read in place.
+ *
+ * Reads 16, 24 and 32-bit integer and 32-bit float samples, with any
+ * number of channels, in plain or extensible format.
+ */
+class MappedWav
+{
+public:
+        ~MappedWav()
+        {
+                close();
+        }
+
+        /// @returns false when path is no WAV file this can read
+        bool open(char const* path)
+        {
+                close();
+                int const fd = ::open(path, O_RDONLY);
+                if (fd < 0) {
+                        return false;
+                }
+                struct stat status;
+                if (fstat(fd, &status) != 0 || status.st_size < 12) {
+                        ::close(fd);
+                        return false;
+                }
+                size = size_t(status.st_size);
+                void* const mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+                ::close(fd);
+                if (mapping == MAP_FAILED) {
+                        size = 0;
+                        return false;
+                }
+                bytes = static_cast<uint8_t const*>(mapping);
+                if (!parse()) {
+                        close();
+                        return false;
+                }
+                return true;
+        }
+
+        void close()
+        {
+                if (bytes) {
+                        munmap(const_cast<uint8_t*>(bytes), size);
+                }
+                bytes = nullptr;
+                size = 0;
+                samples = nullptr;
+                channel_n = 0;
+                frame_n = 0;
+        }
+
+        int channels() const
+        {
+                return channel_n;
+        }
+
+        int64_t frames() const
+        {
+                return frame_n;
+        }
+
+        uint32_t frame_rate() const
+        {
+                return rate;
+        }
+
+        /// @returns the sample in [-1, 1]
+        double sample(int64_t frame, int channel) const
+        {
+                uint8_t const* const p = samples + (frame * channel_n + channel) * sample_size;
+                switch (encoding) {
+                case PCM_16:
+                        return int16_t(get_u16(p)) / 32768.0;
+                case PCM_24: {
+                        // sign extended from the top byte
+                        int32_t const value = int32_t(uint32_t(get_u16(p)) << 8 |
+                                                      uint32_t(p[2]) << 24) >> 8;
+                        return value / 8388608.0;
+                }
+                case PCM_32:
+                        return int32_t(get_u32(p)) / 2147483648.0;
+                case FLOAT_32: {
+                        uint32_t const bits = get_u32(p);
+                        float value;
+                        static_assert(sizeof bits == sizeof value, "32-bit floats expected");
+                        std::memcpy(&value, &bits, sizeof value);
+                        return value;
+                }
+                }
+                return 0.0;
+        }
+
+private:
+        enum Encoding {
+                PCM_16,
+                PCM_24,
+                PCM_32,
+                FLOAT_32,
+        };
+
+        enum {
+                WAVE_FORMAT_PCM = 1,
+                WAVE_FORMAT_IEEE_FLOAT = 3,
+                WAVE_FORMAT_EXTENSIBLE = 0xfffe,
+        };
+
+        // WAV files are little endian whatever the host
+        static uint32_t get_u16(uint8_t const* p)
+        {
+                return uint32_t(p[0]) | uint32_t(p[1]) << 8;
+        }
+
+        static uint32_t get_u32(uint8_t const* p)
+        {
+                return get_u16(p) | get_u16(p + 2) << 16;
+        }
+
+        static bool is_id(uint8_t const* p, char const id[4])
+        {
+                return p[0] == id[0] && p[1] == id[1] && p[2] == id[2] && p[3] == id[3];
+        }
+
+        bool parse()
+        {
+                if (!is_id(bytes, "RIFF") || !is_id(bytes + 8, "WAVE")) {
+                        return false;
+                }
+                bool has_format = false;
+                size_t offset = 12;
+                while (offset + 8 <= size) {
+                        uint8_t const* const chunk = bytes + offset;
+                        size_t const chunk_size = get_u32(chunk + 4);
+                        uint8_t const* const body = chunk + 8;
+                        if (chunk_size > size - offset - 8) {
+                                return false;
+                        }
+                        if (is_id(chunk, "fmt ")) {
+                                has_format = chunk_size >= 16 && parse_format(body, chunk_size);
+                                if (!has_format) {
+                                        return false;
+                                }
+                        } else if (is_id(chunk, "data")) {
+                                if (!has_format) {
+                                        return false;
+                                }
+                                samples = body;
+                                frame_n = int64_t(chunk_size / (sample_size * channel_n));
+                                return true;
+                        }
+                        // chunks are padded to an even size
+                        offset += 8 + chunk_size + (chunk_size & 1);
+                }
+                return false;
+        }
+
+        bool parse_format(uint8_t const* format, size_t format_size)
+        {
+                uint32_t tag = get_u16(format);
+                channel_n = int(get_u16(format + 2));
+                rate = get_u32(format + 4);
+                uint32_t const bits = get_u16(format + 14);
+                if (tag == WAVE_FORMAT_EXTENSIBLE) {
+                        if (format_size < 26) {
+                                return false;
+                        }
+                        // the first two bytes of the sub format GUID
+                        tag = get_u16(format + 24);
+                }
+                if (channel_n == 0) {
+                        return false;
+                }
+                if (tag == WAVE_FORMAT_PCM && bits == 16) {
+                        encoding = PCM_16;
+                } else if (tag == WAVE_FORMAT_PCM && bits == 24) {
+                        encoding = PCM_24;
+                } else if (tag == WAVE_FORMAT_PCM && bits == 32) {
+                        encoding = PCM_32;
+                } else if (tag == WAVE_FORMAT_IEEE_FLOAT && bits == 32) {
+                        encoding = FLOAT_32;
+                } else {
+                        return false;
+                }
+                sample_size = bits / 8;
+                return true;
+        }
+
+        uint8_t const* bytes = nullptr;
+        size_t size = 0;
+
+        uint8_t const* samples = nullptr;
+        Encoding encoding = PCM_16;
+        size_t sample_size = 2;
+        int channel_n = 0;
+        int64_t frame_n = 0;
+        uint32_t rate = 0;
+};
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+/**
+ * Streams stereo 32-bit float samples to a WAV file.
+ *
+ * The sizes in the header are only known once all samples are
+ * written, and get filled in by close(). They are 32-bit, so a file
+ * holds at most MAX_FRAME_N frames, 3.1 hours at 48kHz: writes past
+ * that are refused rather than wrapping the sizes around.
+ */
+class WavWriter
+{
+public:
+        enum {
+                BLOCK_FRAME_N = 1024,
+                FRAME_SIZE = 2 * sizeof(float),
+                /// RIFF header, then the fmt, fact and data chunk headers
+                HEADER_SIZE = 12 + 8 + 18 + 8 + 4 + 8,
+                /// the most that the 32-bit size of the RIFF chunk can count
+                MAX_FRAME_N = (0xffffffffu - (HEADER_SIZE - 8)) / FRAME_SIZE,
+        };
+
+        ~WavWriter()
+        {
+                close();
+        }
+
+        bool open(char const* path, uint32_t frame_rate)
+        {
+                file = std::fopen(path, "wb");
+                if (!file) {
+                        return false;
+                }
+                frame_n = 0;
+                too_long = false;
+
+                std::fwrite("RIFF", 1, 4, file);
+                write_u32(0); // patched by close()
+                std::fwrite("WAVE", 1, 4, file);
+
+                // formats other than PCM have an extension size, and a
+                // fact chunk with their length in frames
+                std::fwrite("fmt ", 1, 4, file);
+                write_u32(18);
+                write_u16(3); // WAVE_FORMAT_IEEE_FLOAT
+                write_u16(2);
+                write_u32(frame_rate);
+                write_u32(frame_rate * FRAME_SIZE);
+                write_u16(FRAME_SIZE);
+                write_u16(32);
+                write_u16(0);
+
+                std::fwrite("fact", 1, 4, file);
+                write_u32(4);
+                write_u32(0); // patched by close()
+
+                std::fwrite("data", 1, 4, file);
+                write_u32(0); // patched by close()
+
+                return !std::ferror(file);
+        }
+
+        /// @returns false if the write failed, or would go past MAX_FRAME_N
+        bool write(double const left[], double const right[], int frame_count)
+        {
+                if (frame_count > int64_t(MAX_FRAME_N - frame_n)) {
+                        too_long = true;
+                        return false;
+                }
+                uint8_t bytes[BLOCK_FRAME_N * 2 * sizeof(float)];
+                for (int i = 0; i < frame_count; i += BLOCK_FRAME_N) {
+                        int const n = frame_count - i < BLOCK_FRAME_N ?
+                                      frame_count - i : BLOCK_FRAME_N;
+                        uint8_t* byte = bytes;
+                        for (int j = 0; j < n; j++) {
+                                byte = put_f32(byte, float(left[i + j]));
+                                byte = put_f32(byte, float(right[i + j]));
+                        }
+                        std::fwrite(bytes, 1, byte - bytes, file);
+                }
+                frame_n += frame_count;
+                return !std::ferror(file);
+        }
+
+        /// @returns false if any write failed, or was refused
+        bool close()
+        {
+                if (!file) {
+                        return true;
+                }
+                uint32_t const data_size = uint32_t(frame_n * FRAME_SIZE);
+                std::fseek(file, 4, SEEK_SET);
+                write_u32(HEADER_SIZE - 8 + data_size);
+                std::fseek(file, HEADER_SIZE - 12, SEEK_SET);
+                write_u32(uint32_t(frame_n));
+                std::fseek(file, HEADER_SIZE - 4, SEEK_SET);
+                write_u32(data_size);
+
+                bool const success = !std::ferror(file) && !too_long;
+                bool const closed = std::fclose(file) == 0;
+                file = nullptr;
+                return success && closed;
+        }
+
+private:
+        // WAV files are little endian whatever the host
+        static uint8_t* put_u32(uint8_t* bytes, uint32_t value)
+        {
+                for (int i = 0; i < 4; i++) {
+                        *bytes++ = uint8_t(value >> (8 * i));
+                }
+                return bytes;
+        }
+
+        static uint8_t* put_f32(uint8_t* bytes, float value)
+        {
+                uint32_t bits;
+                static_assert(sizeof bits == sizeof value, "32-bit floats expected");
+                std::memcpy(&bits, &value, sizeof bits);
+                return put_u32(bytes, bits);
+        }
+
+        void write_u32(uint32_t value)
+        {
+                uint8_t bytes[4];
+                put_u32(bytes, value);
+                std::fwrite(bytes, 1, sizeof bytes, file);
+        }
+
+        void write_u16(uint16_t value)
+        {
+                uint8_t const bytes[] = { uint8_t(value), uint8_t(value >> 8) };
+                std::fwrite(bytes, 1, sizeof bytes, file);
+        }
+
+        std::FILE* file = nullptr;
+        uint64_t frame_n = 0;
+        bool too_long = false;
+};
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+/**
+ * A pool of threads sharing batches of jobs with the thread that
+ * submits them, without locks, allocations nor system calls on the
+ * submitting thread once started.
+ *
+ * A batch is a function taking a job index. Each job has a slot
+ * holding the last batch that started it, and a job is started by
+ * whoever first moves its slot to the current batch: the workers and
+ * the submitting thread alike, which goes through all the slots. By
+ * the time it is done with them, every job is running or done, so a
+ * batch completes even when no worker is awake, and the submitting
+ * thread only ever waits for jobs a worker is in the middle of.
+ *
+ * Idle workers spin, yielding, for IDLE_MICROS, a little more than the
+ * period of the audio blocks, so that they are there for the next
+ * block. Past that they nap for NAP_MICROS at a time, still checking
+ * for new batches: nothing ever has to wake them.
+ */
+class Workers
+{
+public:
+        typedef void (*JobFn)(void* context, int job);
+
+        enum {
+                /// 256 samples at 48kHz last 5333us
+                IDLE_MICROS = 6000,
+                NAP_MICROS = 1000,
+                MAX_JOB_N = 64,
+        };
+
+        ~Workers()
+        {
+                stop();
+        }
+
+        void start(int worker_n)
+        {
+                assert(threads.empty());
+                quit.store(false);
+                for (int i = 0; i < worker_n; i++) {
+                        threads.emplace_back([this]() {
+                                work();
+                        });
+                }
+        }
+
+        void stop()
+        {
+                quit.store(true);
+                for (auto& thread : threads) {
+                        thread.join();
+                }
+                threads.clear();
+        }
+
+        int size() const
+        {
+                return int(threads.size());
+        }
+
+        /// runs fn for jobs [0, job_n) and returns once they are all done
+        void run(JobFn fn, void* context, int job_n)
+        {
+                assert(job_n <= MAX_JOB_N);
+                batch_fn = fn;
+                batch_context = context;
+                done_n.store(0, std::memory_order_relaxed);
+                uint64_t const batch = (++batch_n << JOB_N_BITS) | uint64_t(job_n);
+                current_batch.store(batch, std::memory_order_release);
+
+                run_jobs(batch);
+                while (done_n.load(std::memory_order_acquire) < job_n) {
+                        // only jobs already running on workers are left
+                }
+        }
+
+private:
+        enum {
+                JOB_N_BITS = 8,
+        };
+        static_assert(MAX_JOB_N < (1 << JOB_N_BITS), "the job count must fit in a batch");
+
+        /// runs the jobs of batch that nobody started yet
+        void run_jobs(uint64_t const batch)
+        {
+                // the batch number goes up with every batch, so that a
+                // worker still on a previous one never starts a job
+                uint64_t const number = batch >> JOB_N_BITS;
+                int const job_n = int(batch & ((1 << JOB_N_BITS) - 1));
+                for (int job = 0; job < job_n; job++) {
+                        uint64_t started = job_batches[job].load(std::memory_order_relaxed);
+                        if (started >= number ||
+                            !job_batches[job].compare_exchange_strong(started, number,
+                                                                      std::memory_order_acq_rel)) {
+                                continue;
+                        }
+                        // the batch cannot end before this job, so its state is still ours
+                        batch_fn(batch_context, job);
+                        done_n.fetch_add(1, std::memory_order_release);
+                }
+        }
+
+        void work()
+        {
+                using std::chrono::steady_clock;
+                using std::chrono::microseconds;
+
+                uint64_t batch = current_batch.load(std::memory_order_acquire);
+                auto idle_since = steady_clock::now();
+                while (!quit.load(std::memory_order_relaxed)) {
+                        uint64_t const new_batch = current_batch.load(std::memory_order_acquire);
+                        if (new_batch != batch) {
+                                batch = new_batch;
+                                run_jobs(batch);
+                                idle_since = steady_clock::now();
+                        } else if (steady_clock::now() - idle_since >
+                                   microseconds(IDLE_MICROS)) {
+                                std::this_thread::sleep_for(microseconds(NAP_MICROS));
+                        } else {
+                                std::this_thread::yield();
+                        }
+                }
+        }
+
+        std::vector<std::thread> threads;
+        std::atomic<bool> quit { false };
+
+        /// the batch number, shifted by JOB_N_BITS, and its job count
+        std::atomic<uint64_t> current_batch { 0 };
+        std::atomic<uint64_t> job_batches[MAX_JOB_N] = {};
+        std::atomic<int> done_n { 0 };
+        uint64_t batch_n = 0;
+
+        JobFn batch_fn = nullptr;
+        void* batch_context = nullptr;
+};
@@ -6,6 +6,7 @@
 #include <micros/gl3.h>
 
 #include <cassert>
+#include <cstring>
 
 void render_next_gl3(uint64_t time_micros,
                      struct Display display)
@@ -47,6 +48,12 @@ void render_next_2chn_48khz_audio(uint64_t time_micros,
 
 int main (int argc, char** argv)
 {
+        for (int i = 1; i < argc; i++) {
+                if (0 == strcmp(argv[i], "--easy-font")) {
+                        draw_debug_string_backend(DEBUG_STRING_EASY_FONT);
+                }
+        }
+
         runtime_init();
 
         return 0;
@@ -1,4 +1,7 @@
+#include "render-debug-string.hpp"
+
 #include "../compile.hpp"
+#include "../streaming_buffer.hpp"
 
 #include <GL/glew.h>
 
@@ -8,7 +11,9 @@ BEGIN_NOWARN_BLOCK
 #include "../../modules/stb/stb_easy_font.h"
 END_NOWARN_BLOCK
 
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 #include <memory>
 #include <vector>
 
@@ -21,34 +26,386 @@ int draw_debug_string_maxchar()
         return MAX_CHAR_N;
 }
 
+static DebugStringBackend gbl_debugStringBackend = DEBUG_STRING_GLYPH_ATLAS;
+
+void draw_debug_string_backend(DebugStringBackend backend)
+{
+        gbl_debugStringBackend = backend;
+}
+
+enum {
+        // 64k glyph instances, the largest texture buffer GL 3.2 guarantees
+        DEBUG_STRING_STREAM_SIZE = 512 * 1024,
+};
+
+/// where both backends upload their vertices or instances
+static StreamingBuffer& debug_string_stream()
+{
+        static StreamingBuffer stream;
+        static bool mustInit = true;
+        if (mustInit) {
+                mustInit = false;
+                stream.init(GL_ARRAY_BUFFER, DEBUG_STRING_STREAM_SIZE);
+        }
+        return stream;
+}
+
+enum {
+        STB_EASY_FONT_VERTEX_BUFFER_ELEMENT_SIZE = 3*sizeof(float) + 4,
+        // the GPU memory budget of the geometry cache
+        GEOMETRY_CACHE_SIZE = 2 * 1024 * 1024,
+        GEOMETRY_CACHE_BLOCK_SIZE = 1024,
+        GEOMETRY_CACHE_BLOCK_N = GEOMETRY_CACHE_SIZE / GEOMETRY_CACHE_BLOCK_SIZE,
+        // a string takes at least a block
+        GEOMETRY_CACHE_ENTRY_N = GEOMETRY_CACHE_BLOCK_N,
+        GEOMETRY_CACHE_BUCKET_N = 2 * GEOMETRY_CACHE_ENTRY_N,
+        // strings drawn once, remembered until they are drawn again
+        GEOMETRY_CANDIDATE_N = 1024,
+        GEOMETRY_CACHE_FENCE_N = 4,
+        NO_ENTRY = -1,
+};
+
 /*
-  Draw a message at a pixel position.
+  A string as laid out by stb_easy_font_print.
 
-  @param scalePower 0,1,2 ... 0 shows the original font, 1 doubles it etc...
+  The text itself is not kept, only its length and 64 bit hash: two
+  texts colliding at the same place and scale, a 2^-64 chance for
+  any pair, would show one for the other. Fine for debug strings.
 */
-void draw_debug_string(float pixelX, float pixelY,
-                       char const* message,
-                       int scalePower,
-                       uint32_t framebuffer_width_px,
-                       uint32_t framebuffer_height_px)
+struct GeometryKey {
+        uint64_t textHash;
+        uint32_t textLength;
+        float x;
+        float y;
+        int scalePower;
+
+        bool operator==(GeometryKey const& other) const
+        {
+                return textHash == other.textHash && textLength == other.textLength &&
+                       x == other.x && y == other.y && scalePower == other.scalePower;
+        }
+};
+
+static uint64_t geometry_key_hash(GeometryKey const& key)
 {
-        enum {
-                STB_EASY_FONT_VERTEX_BUFFER_ELEMENT_SIZE = 3*sizeof(float) + 4,
-                MAX_QUAD_N = 270 * MAX_CHAR_N / (4*STB_EASY_FONT_VERTEX_BUFFER_ELEMENT_SIZE),
+        uint32_t x, y;
+        memcpy(&x, &key.x, sizeof x);
+        memcpy(&y, &key.y, sizeof y);
+        auto hash = key.textHash ^ (uint64_t(x) << 32 | y) ^ uint64_t(key.scalePower);
+        // the murmur3 finalizer, as whole pixel positions leave the low
+        // bits of the floats at zero
+        hash = (hash ^ hash >> 33) * 0xff51afd7ed558ccdull;
+        hash = (hash ^ hash >> 33) * 0xc4ceb9fe1a85ec53ull;
+        return hash ^ hash >> 33;
+}
+
+/*
+  The vertices of the strings drawn lately, resident in a GPU buffer
+  of GEOMETRY_CACHE_SIZE bytes, evicting the least recently used
+  strings when full.
+
+  A string is only copied in, out of the stream it was drawn from,
+  once it was drawn unchanged in two flushes, so that strings changing
+  every frame never churn the cache.
+
+  The blocks of evicted strings may still be read by draws the GPU has
+  not done yet, so they are reused only once the fence of the flush
+  that evicted them has signaled.
+*/
+static struct GeometryCache {
+        struct Entry {
+                GeometryKey key;
+                int firstBlock;
+                int blockCount;
+                int quadCount;
+                uint64_t lastFlush;
+                // in the least recently used order, or the free entries
+                int previous;
+                int next;
+                int nextInBucket;
+        };
+
+        Entry entries[GEOMETRY_CACHE_ENTRY_N];
+        int buckets[GEOMETRY_CACHE_BUCKET_N];
+        int mostRecent = NO_ENTRY;
+        int leastRecent = NO_ENTRY;
+        int firstFree = NO_ENTRY;
+
+        struct Candidate {
+                GeometryKey key;
+                uint64_t flush;
+        } candidates[GEOMETRY_CANDIDATE_N] = {};
+        uint64_t flush = 0;
+
+        // per block: BLOCK_USED, or the epoch it was freed at, 0 when never used
+        enum : uint64_t {
+                BLOCK_USED = ~uint64_t(0),
         };
-        static struct Resources {
-                GLuint shaders[2] = {};
-                GLuint shaderProgram = 0;
-                GLuint buffers[2] = {};
-                GLuint stbVertexBuffer = 0;
-                GLuint vertexArray = 0;
-
-                // dynamic data
-                std::unique_ptr<void, void (*)(void*)>
-                stbEasyFontVertexBuffer = { nullptr, nullptr };
-                size_t stbEasyFontVertexBufferSize = 0;
-        } all;
+        uint64_t blockStates[GEOMETRY_CACHE_BLOCK_N] = {};
+        // blocks freed at epochs up to retiredEpoch can be reused
+        uint64_t epoch = 1;
+        uint64_t retiredEpoch = 0;
+        bool mustFence = false;
+        struct Fence {
+                GLsync sync;
+                uint64_t epoch;
+        } fences[GEOMETRY_CACHE_FENCE_N];
+        int firstFence = 0;
+        int fenceCount = 0;
+
+        GLuint buffer = 0;
+        GLuint vertexArray = 0;
+
+        DebugStringCacheStats stats = {};
+} gbl_geometryCache;
+
+DebugStringCacheStats draw_debug_string_cache_stats()
+{
+        return gbl_geometryCache.stats;
+}
+
+/// FNV-1a
+static uint64_t hash_string(char const* text, uint32_t* length)
+{
+        uint64_t hash = 0xcbf29ce484222325ull;
+        auto c = text;
+        for (; *c; c++) {
+                hash = (hash ^ uint8_t(*c)) * 0x100000001b3ull;
+        }
+        *length = uint32_t(c - text);
+        return hash;
+}
+
+static void geometry_cache_init(GeometryCache& cache)
+{
+        for (auto& bucket : cache.buckets) {
+                bucket = NO_ENTRY;
+        }
+        for (int i = 0; i < GEOMETRY_CACHE_ENTRY_N; i++) {
+                cache.entries[i].next = i + 1 < GEOMETRY_CACHE_ENTRY_N ? i + 1 : NO_ENTRY;
+        }
+        cache.firstFree = 0;
+}
+
+static int& geometry_cache_bucket(GeometryKey const& key)
+{
+        return gbl_geometryCache.buckets[geometry_key_hash(key) % GEOMETRY_CACHE_BUCKET_N];
+}
+
+static void geometry_cache_unlink(int entryIndex)
+{
+        auto& cache = gbl_geometryCache;
+        auto const& entry = cache.entries[entryIndex];
+        (entry.previous == NO_ENTRY ? cache.mostRecent : cache.entries[entry.previous].next) =
+                entry.next;
+        (entry.next == NO_ENTRY ? cache.leastRecent : cache.entries[entry.next].previous) =
+                entry.previous;
+}
+
+static void geometry_cache_link_first(int entryIndex)
+{
+        auto& cache = gbl_geometryCache;
+        auto& entry = cache.entries[entryIndex];
+        entry.previous = NO_ENTRY;
+        entry.next = cache.mostRecent;
+        (cache.mostRecent == NO_ENTRY ? cache.leastRecent : cache.entries[cache.mostRecent].previous) =
+                entryIndex;
+        cache.mostRecent = entryIndex;
+}
+
+static GeometryCache::Entry const* geometry_cache_find(GeometryKey const& key)
+{
+        auto& cache = gbl_geometryCache;
+        auto entryIndex = geometry_cache_bucket(key);
+        while (entryIndex != NO_ENTRY && !(cache.entries[entryIndex].key == key)) {
+                entryIndex = cache.entries[entryIndex].nextInBucket;
+        }
+        if (entryIndex == NO_ENTRY) {
+                cache.stats.misses++;
+                return nullptr;
+        }
+        geometry_cache_unlink(entryIndex);
+        geometry_cache_link_first(entryIndex);
+        auto& entry = cache.entries[entryIndex];
+        entry.lastFlush = cache.flush;
+        cache.stats.hits++;
+        return &entry;
+}
+
+/// evicts an entry, its blocks to be reused once the current flush is fenced
+static void geometry_cache_remove(int entryIndex)
+{
+        auto& cache = gbl_geometryCache;
+        auto& entry = cache.entries[entryIndex];
+        for (int block = entry.firstBlock; block < entry.firstBlock + entry.blockCount; block++) {
+                cache.blockStates[block] = cache.epoch;
+        }
+        cache.mustFence = true;
+        cache.stats.residentBytes -= entry.blockCount * GEOMETRY_CACHE_BLOCK_SIZE;
+        cache.stats.residentStrings--;
+
+        auto* link = &geometry_cache_bucket(entry.key);
+        while (*link != entryIndex) {
+                link = &cache.entries[*link].nextInBucket;
+        }
+        *link = entry.nextInBucket;
+        geometry_cache_unlink(entryIndex);
+        entry.next = cache.firstFree;
+        cache.firstFree = entryIndex;
+}
+
+/// frees the blocks the GPU is done with, without ever waiting for it
+static void geometry_cache_retire()
+{
+        auto& cache = gbl_geometryCache;
+        while (cache.fenceCount > 0) {
+                auto& oldest = cache.fences[cache.firstFence];
+                GLint status = GL_UNSIGNALED;
+                glGetSynciv(oldest.sync, GL_SYNC_STATUS, 1, NULL, &status);
+                if (status != GL_SIGNALED) {
+                        break;
+                }
+                cache.retiredEpoch = oldest.epoch;
+                glDeleteSync(oldest.sync);
+                cache.firstFence = (cache.firstFence + 1) % GEOMETRY_CACHE_FENCE_N;
+                cache.fenceCount--;
+        }
+}
+
+/// fences the draws of the flush that evicted some strings
+static void geometry_cache_fence()
+{
+        auto& cache = gbl_geometryCache;
+        if (!cache.mustFence) {
+                return;
+        }
+        cache.mustFence = false;
+        auto const sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        if (cache.fenceCount == GEOMETRY_CACHE_FENCE_N) {
+                // the newest fence is replaced by this later one, covering both
+                auto& newest = cache.fences[(cache.firstFence + cache.fenceCount - 1) %
+                                            GEOMETRY_CACHE_FENCE_N];
+                glDeleteSync(newest.sync);
+                newest = { sync, cache.epoch };
+        } else {
+                cache.fences[(cache.firstFence + cache.fenceCount) % GEOMETRY_CACHE_FENCE_N] = {
+                        sync, cache.epoch,
+                };
+                cache.fenceCount++;
+        }
+        cache.epoch++;
+}
 
+/// @returns the first of blockCount free contiguous blocks, or -1
+static int geometry_cache_find_blocks(int blockCount)
+{
+        auto const& cache = gbl_geometryCache;
+        auto freeCount = 0;
+        for (int block = 0; block < GEOMETRY_CACHE_BLOCK_N; block++) {
+                auto const state = cache.blockStates[block];
+                auto const isFree = state != GeometryCache::BLOCK_USED &&
+                                    state <= cache.retiredEpoch;
+                freeCount = isFree ? freeCount + 1 : 0;
+                if (freeCount == blockCount) {
+                        return block + 1 - blockCount;
+                }
+        }
+        return -1;
+}
+
+/*
+  Remember that key was drawn in this flush.
+
+  @returns true when it was also drawn in an earlier flush
+*/
+static bool geometry_cache_was_drawn_before(GeometryKey const& key)
+{
+        auto& cache = gbl_geometryCache;
+        auto& candidate = cache.candidates[geometry_key_hash(key) % GEOMETRY_CANDIDATE_N];
+        auto const drawnBefore = candidate.flush != 0 && candidate.flush != cache.flush &&
+                                 candidate.key == key;
+        candidate = { key, cache.flush };
+        return drawnBefore;
+}
+
+/*
+  Copy the vertices of a string, just streamed at streamOffset, in the
+  cache. When there is no room, evicts the least recently used string
+  instead, to retry in a later flush.
+*/
+static void geometry_cache_insert(GeometryKey const& key, GLintptr streamOffset, int quadCount)
+{
+        auto& cache = gbl_geometryCache;
+        auto const verticesSize = 4*quadCount * STB_EASY_FONT_VERTEX_BUFFER_ELEMENT_SIZE;
+        auto const blockCount = (verticesSize + GEOMETRY_CACHE_BLOCK_SIZE - 1) /
+                                GEOMETRY_CACHE_BLOCK_SIZE;
+        if (blockCount > GEOMETRY_CACHE_BLOCK_N) {
+                return;
+        }
+
+        auto const firstBlock = geometry_cache_find_blocks(blockCount);
+        if (firstBlock < 0 || cache.firstFree == NO_ENTRY) {
+                // except for the strings this flush still draws
+                auto const lru = cache.leastRecent;
+                if (lru != NO_ENTRY && cache.entries[lru].lastFlush != cache.flush) {
+                        geometry_cache_remove(lru);
+                        cache.stats.evictions++;
+                }
+                return;
+        }
+        for (int block = firstBlock; block < firstBlock + blockCount; block++) {
+                cache.blockStates[block] = GeometryCache::BLOCK_USED;
+        }
+
+        glBindBuffer(GL_COPY_READ_BUFFER, debug_string_stream().buffer());
+        glBindBuffer(GL_COPY_WRITE_BUFFER, cache.buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, streamOffset,
+                            firstBlock * GEOMETRY_CACHE_BLOCK_SIZE, verticesSize);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+        auto const entryIndex = cache.firstFree;
+        auto& entry = cache.entries[entryIndex];
+        cache.firstFree = entry.next;
+        auto& bucket = geometry_cache_bucket(key);
+        entry = {
+                key, firstBlock, blockCount, quadCount, cache.flush,
+                NO_ENTRY, NO_ENTRY, bucket,
+        };
+        bucket = entryIndex;
+        geometry_cache_link_first(entryIndex);
+        cache.stats.residentBytes += blockCount * GEOMETRY_CACHE_BLOCK_SIZE;
+        cache.stats.residentStrings++;
+}
+
+enum {
+        EASY_FONT_MAX_QUAD_N = 270 * MAX_CHAR_N / (4*STB_EASY_FONT_VERTEX_BUFFER_ELEMENT_SIZE),
+};
+
+/*
+  The GL objects drawing the quads of stb_easy_font, out of the
+  geometry cache or streamed.
+*/
+static struct EasyFont {
+        GLuint shaders[2] = {};
+        GLuint shaderProgram = 0;
+        GLint resolutionLocation = -1;
+        GLint fontPixelSizeLocation = -1;
+        GLuint indexBuffer = 0;
+        GLuint vertexArray = 0;
+
+        // dynamic data
+        std::unique_ptr<void, void (*)(void*)>
+        stbEasyFontVertexBuffer = { nullptr, nullptr };
+        size_t stbEasyFontVertexBufferSize = 0;
+} gbl_easyFont;
+
+static EasyFont& easy_font()
+{
+        enum {
+                MAX_QUAD_N = EASY_FONT_MAX_QUAD_N,
+        };
+        auto& all = gbl_easyFont;
         static bool mustInit = true;
         if (mustInit) {
                 mustInit = false;
@@ -156,80 +513,419 @@ void draw_debug_string(float pixelX, float pixelY,
                                         fprintf(stderr, "error: %s while compiling program #1\n", &output.front());
                                 }
                         }
-
+                        all.resolutionLocation = glGetUniformLocation(all.shaderProgram,
+                                                                      "iResolution");
+                        all.fontPixelSizeLocation = glGetUniformLocation(all.shaderProgram,
+                                                                         "iFontPixelSize");
                 }
 
-                struct BufferDef {
-                        GLenum target;
-                        GLenum usage;
-                        GLvoid const* data;
-                        GLsizeiptr count;
-                        GLsizeiptr elementSize;
-                        GLint componentCount;
-                        GLint shaderAttrib;
-                } bufferDefs[] = {
-                        { GL_ELEMENT_ARRAY_BUFFER, GL_STATIC_DRAW, stbVertexIndices, stbVertexIndicesSize, sizeof *stbVertexIndices, 0, 0 },
-                        { GL_ARRAY_BUFFER, GL_DYNAMIC_DRAW, NULL, 0, STB_EASY_FONT_VERTEX_BUFFER_ELEMENT_SIZE, 2, glGetAttribLocation(all.shaderProgram, "position") },
-                };
+                glGenBuffers(1, &all.indexBuffer);
+                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, all.indexBuffer);
+                glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                             stbVertexIndicesSize * sizeof *stbVertexIndices, stbVertexIndices,
+                             GL_STATIC_DRAW);
+                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+                auto& cache = gbl_geometryCache;
+                glGenBuffers(1, &cache.buffer);
+                glBindBuffer(GL_ARRAY_BUFFER, cache.buffer);
+                glBufferData(GL_ARRAY_BUFFER, GEOMETRY_CACHE_SIZE, NULL, GL_DYNAMIC_COPY);
+                glBindBuffer(GL_ARRAY_BUFFER, 0);
+                geometry_cache_init(cache);
 
-                glGenBuffers(sizeof bufferDefs / sizeof bufferDefs[0],
-                             all.buffers);
-                // a copy to make things easy
-                all.stbVertexBuffer = all.buffers[1];
+                glGenVertexArrays(1, &cache.vertexArray);
+                glBindVertexArray(cache.vertexArray);
                 {
-                        auto i = 0;
-                        for (auto def : bufferDefs) {
-                                auto id = all.buffers[i++];
-                                glBindBuffer(def.target, id);
-                                glBufferData(def.target, def.count * def.elementSize, def.data, def.usage);
-                                glBindBuffer(def.target, 0);
-                        }
+                        auto positionAttrib = glGetAttribLocation(all.shaderProgram, "position");
+                        glEnableVertexAttribArray(positionAttrib);
+                        glBindBuffer(GL_ARRAY_BUFFER, cache.buffer);
+                        glVertexAttribPointer(positionAttrib, 2, GL_FLOAT, GL_FALSE,
+                                              STB_EASY_FONT_VERTEX_BUFFER_ELEMENT_SIZE, 0);
+                        glBindBuffer(GL_ARRAY_BUFFER, 0);
                 }
 
+                // the vertices of strings not in the cache are streamed
                 glGenVertexArrays(1, &all.vertexArray);
                 glBindVertexArray(all.vertexArray);
                 {
-                        auto i = 0;
-                        for (auto def : bufferDefs) {
-                                auto id = all.buffers[i++];
-                                if (def.target != GL_ARRAY_BUFFER) {
-                                        continue;
-                                }
-                                glEnableVertexAttribArray(def.shaderAttrib);
-                                glBindBuffer(def.target, id);
-                                glVertexAttribPointer(def.shaderAttrib, def.componentCount, GL_FLOAT,
-                                                      GL_FALSE, def.elementSize, 0);
-                                glBindBuffer(def.target, 0);
-                        }
+                        auto positionAttrib = glGetAttribLocation(all.shaderProgram, "position");
+                        glEnableVertexAttribArray(positionAttrib);
+                        glBindBuffer(GL_ARRAY_BUFFER, debug_string_stream().buffer());
+                        glVertexAttribPointer(positionAttrib, 2, GL_FLOAT, GL_FALSE,
+                                              STB_EASY_FONT_VERTEX_BUFFER_ELEMENT_SIZE, 0);
+                        glBindBuffer(GL_ARRAY_BUFFER, 0);
                 }
                 glBindVertexArray(0);
                 delete[] stbVertexIndices;
         }
+        return all;
+}
+
+/*
+  Draw a message at a pixel position, with quads generated by
+  stb_easy_font and streamed, unless the same message was drawn at the
+  same place lately and its quads are still in the geometry cache.
+
+  Expects the program of all in use, with its resolution set.
 
+  @param scalePower 0,1,2 ... 0 shows the original font, 1 doubles it etc...
+  @returns true when the quads were streamed, to be fenced after the draws
+*/
+static bool draw_debug_string_easy_font(EasyFont const& all,
+                                        float pixelX, float pixelY,
+                                        char const* message,
+                                        int scalePower)
+{
         // DYNAMIC DATA -> GPU
 
         auto scale = 7.0f / (7 << scalePower);
+        auto key = GeometryKey {
+                0, 0, scale * pixelX, scale * pixelY, scalePower,
+        };
+        key.textHash = hash_string(message, &key.textLength);
         int indicesCount;
-        {
-                auto glBufferId = all.stbVertexBuffer;
+        GLint baseVertex;
+        GLuint vertexArray;
+        bool streamed = false;
+        if (auto entry = geometry_cache_find(key)) {
+                indicesCount = 6*entry->quadCount;
+                baseVertex = entry->firstBlock * GEOMETRY_CACHE_BLOCK_SIZE /
+                             STB_EASY_FONT_VERTEX_BUFFER_ELEMENT_SIZE;
+                vertexArray = gbl_geometryCache.vertexArray;
+        } else {
                 auto vertexBuffer = all.stbEasyFontVertexBuffer.get();
                 auto vertexBufferSize = all.stbEasyFontVertexBufferSize;
 
-                auto quadCount = stb_easy_font_print(scale * pixelX, scale * pixelY,
+                auto quadCount = stb_easy_font_print(key.x, key.y,
                                                      const_cast<char*>(message),
                                                      NULL, vertexBuffer, vertexBufferSize);
+                if (quadCount == 0) {
+                        return false;
+                }
 
-                glBindBuffer(GL_ARRAY_BUFFER, glBufferId);
-                glBufferData(GL_ARRAY_BUFFER,
-                             4*quadCount * STB_EASY_FONT_VERTEX_BUFFER_ELEMENT_SIZE,
-                             vertexBuffer, GL_DYNAMIC_DRAW);
-                glBindBuffer(GL_ARRAY_BUFFER, 0);
+                auto& stream = debug_string_stream();
+                auto verticesSize = 4*quadCount * STB_EASY_FONT_VERTEX_BUFFER_ELEMENT_SIZE;
+                auto allocation = stream.map(verticesSize,
+                                             STB_EASY_FONT_VERTEX_BUFFER_ELEMENT_SIZE);
+                if (!allocation.data) {
+                        return false;
+                }
+                memcpy(allocation.data, vertexBuffer, verticesSize);
+                stream.unmap(&allocation, verticesSize);
+                if (geometry_cache_was_drawn_before(key)) {
+                        geometry_cache_insert(key, allocation.offset, quadCount);
+                }
 
                 indicesCount = 6*quadCount;
+                baseVertex = GLint(allocation.offset /
+                                   STB_EASY_FONT_VERTEX_BUFFER_ELEMENT_SIZE);
+                vertexArray = all.vertexArray;
+                streamed = true;
         }
 
         // Drawing code
 
+        glUniform1i(all.fontPixelSizeLocation, (7 << scalePower));
+        glBindVertexArray(vertexArray);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, all.indexBuffer);
+        glDrawElementsBaseVertex(GL_TRIANGLES, indicesCount, GL_UNSIGNED_INT, 0, baseVertex);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        glBindVertexArray(0);
+        return streamed;
+}
+
+enum {
+        // stb_easy_font glyphs are printable ascii characters
+        FIRST_GLYPH_CHAR = 32,
+        GLYPH_N = 127 - FIRST_GLYPH_CHAR,
+        // in font pixels, wide enough for any glyph and its descent
+        GLYPH_CELL_PX = 16,
+        ATLAS_COLUMN_N = 16,
+        ATLAS_ROW_N = (GLYPH_N + ATLAS_COLUMN_N - 1) / ATLAS_COLUMN_N,
+        // as stb_easy_font_print moves down on new lines
+        LINE_HEIGHT_PX = 12,
+};
+
+/// one glyph to draw, as read by the vertex shader in a texture buffer
+struct GlyphInstance {
+        /// top left corner, in framebuffer pixels
+        int16_t x;
+        int16_t y;
+        int16_t glyph;
+        int16_t scalePower;
+};
+
+enum {
+        MAX_BATCH_GLYPH_N = 16 * MAX_CHAR_N,
+        MAX_BATCH_STRING_N = 1024,
+};
+
+/// what draw_debug_string_flush will draw
+static struct DebugStringBatch {
+        // glyph atlas backend
+        GlyphInstance instances[MAX_BATCH_GLYPH_N];
+        int instanceCount = 0;
+
+        // stb_easy_font backend, which still draws string by string
+        struct QueuedString {
+                float pixelX;
+                float pixelY;
+                int scalePower;
+                int textStart;
+        } strings[MAX_BATCH_STRING_N];
+        int stringCount = 0;
+        char text[MAX_BATCH_GLYPH_N];
+        int textSize = 0;
+} gbl_debugStringBatch;
+
+/*
+  The atlas, rasterized once from stb_easy_font, and the GL objects
+  drawing its glyphs as instances, each fetched from a texture buffer
+  by its gl_InstanceID.
+*/
+static struct GlyphAtlas {
+        GLuint shaders[2] = {};
+        GLuint shaderProgram = 0;
+        GLint resolutionLocation = -1;
+        GLint firstInstanceLocation = -1;
+        GLuint vertexArray = 0;
+        GLuint atlasTexture = 0;
+        GLuint instanceTexture = 0;
+
+        // in font pixels
+        uint8_t glyphAdvances[GLYPH_N] = {};
+} gbl_glyphAtlas;
+
+static GlyphAtlas& glyph_atlas()
+{
+        auto& all = gbl_glyphAtlas;
+        static bool mustInit = true;
+        if (mustInit) {
+                mustInit = false;
+
+                // PREPARE DATA
+
+                // rasterize the quads of every glyph in its cell
+                auto const atlasWidth = ATLAS_COLUMN_N * GLYPH_CELL_PX;
+                auto const atlasHeight = ATLAS_ROW_N * GLYPH_CELL_PX;
+                auto atlasPixels = std::vector<uint8_t>(atlasWidth * atlasHeight, 0);
+                {
+                        enum {
+                                VERTEX_SIZE = 3 * sizeof(float) + 4,
+                                GLYPH_MAX_QUAD_N = 64,
+                        };
+                        float vertices[GLYPH_MAX_QUAD_N * 4 * VERTEX_SIZE / sizeof(float)];
+                        for (int glyph = 0; glyph < GLYPH_N; glyph++) {
+                                char text[2] = { char(FIRST_GLYPH_CHAR + glyph), '\0' };
+                                all.glyphAdvances[glyph] = uint8_t(stb_easy_font_width(text));
+
+                                auto quadCount = stb_easy_font_print(0.0f, 0.0f, text, NULL,
+                                                                     vertices, sizeof vertices);
+                                auto const cellX = (glyph % ATLAS_COLUMN_N) * GLYPH_CELL_PX;
+                                auto const cellY = (glyph / ATLAS_COLUMN_N) * GLYPH_CELL_PX;
+                                for (int quad = 0; quad < quadCount; quad++) {
+                                        // the top left and bottom right corners
+                                        auto const* topLeft = reinterpret_cast<float const*>(
+                                                reinterpret_cast<char const*>(vertices) +
+                                                4 * quad * VERTEX_SIZE);
+                                        auto const* bottomRight = reinterpret_cast<float const*>(
+                                                reinterpret_cast<char const*>(topLeft) +
+                                                2 * VERTEX_SIZE);
+                                        for (int y = int(topLeft[1]); y < int(bottomRight[1]); y++) {
+                                                for (int x = int(topLeft[0]); x < int(bottomRight[0]); x++) {
+                                                        assert(x >= 0 && x < GLYPH_CELL_PX);
+                                                        assert(y >= 0 && y < GLYPH_CELL_PX);
+                                                        atlasPixels[(cellY + y) * atlasWidth + cellX + x] = 255;
+                                                }
+                                        }
+                                }
+                        }
+                }
+
+                char const* vertexShaderStrings[] = {
+                        "#version 150\n",
+                        "uniform vec3 iResolution;\n",
+                        "uniform isamplerBuffer glyphInstances;\n",
+                        "uniform int firstInstance;\n",
+                        "const int GLYPH_CELL_PX = 16;\n",
+                        "const int ATLAS_COLUMN_N = 16;\n",
+                        "out vec2 atlasTexel;\n",
+                        "void main()\n",
+                        "{\n",
+                        "    ivec4 instance = texelFetch(glyphInstances, firstInstance + gl_InstanceID);\n",
+                        "    vec2 corner = GLYPH_CELL_PX * vec2(gl_VertexID & 1, gl_VertexID >> 1);\n",
+                        "    ivec2 cell = ivec2(instance.z % ATLAS_COLUMN_N, instance.z / ATLAS_COLUMN_N);\n",
+                        "    atlasTexel = GLYPH_CELL_PX * vec2(cell) + corner;\n",
+                        "    float scale = float(1 << instance.w);\n",
+                        "    vec2 pixelEdge = vec2(instance.xy) + scale * corner;\n",
+                        "    vec2 pixel00 = vec2(-1.0, 1.0);\n",
+                        "    vec2 pixelEdgeToVertexPosition = vec2(2.0, -2.0)/iResolution.xy;",
+                        "    gl_Position = vec4(pixel00 + pixelEdgeToVertexPosition * pixelEdge, 0.0, 1.0);\n",
+                        "}\n",
+                        nullptr,
+                };
+                char const* fragmentShaderStrings[] = {
+                        "#version 150\n",
+                        "uniform sampler2D glyphAtlas;\n",
+                        "in vec2 atlasTexel;\n",
+                        "out vec4 oColor;\n",
+                        "void main()\n",
+                        "{\n",
+                        "    if (texelFetch(glyphAtlas, ivec2(atlasTexel), 0).r < 0.5) {\n",
+                        "        discard;\n",
+                        "    }\n",
+                        "    oColor = vec4(1.0, 1.0, 1.0, 1.0);\n",
+                        "}\n",
+                        nullptr
+                };
+
+                // DATA -> GPU
+
+                auto countStrings = [](char const* lineArray[]) -> GLint {
+                        auto count = 0;
+                        while (*lineArray++)
+                        {
+                                count++;
+                        }
+                        return count;
+                };
+
+                struct ShaderDef {
+                        GLenum type;
+                        char const** lines;
+                        GLint lineCount;
+                        char const* source;
+                } shaderDefs[2] = {
+                        { GL_VERTEX_SHADER, vertexShaderStrings, countStrings(vertexShaderStrings), __FILE__ },
+                        { GL_FRAGMENT_SHADER, fragmentShaderStrings, countStrings(fragmentShaderStrings), __FILE__ },
+                };
+                {
+                        auto i = 0;
+                        all.shaderProgram  = glCreateProgram();
+
+                        for (auto def : shaderDefs) {
+                                GLuint shader = glCreateShader(def.type);
+                                glShaderSource(shader, def.lineCount, def.lines, NULL);
+                                glCompileShader(shader);
+                                GLint status;
+                                glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+                                if (status == GL_FALSE) {
+                                        GLint length;
+                                        glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+                                        auto output = std::vector<char> {};
+                                        output.reserve(length + 1);
+                                        glGetShaderInfoLog(shader, length, &length, &output.front());
+                                        fprintf(stderr, "error:%s:0:%s while compiling shader #%d\n", def.source,
+                                                &output.front(), 1+i);
+                                }
+                                glAttachShader(all.shaderProgram, shader);
+                                all.shaders[i++] = shader;
+                        }
+                        glLinkProgram(all.shaderProgram);
+                        {
+                                auto program = all.shaderProgram;
+                                GLint status;
+                                glGetProgramiv(program, GL_LINK_STATUS, &status);
+                                if (status == GL_FALSE) {
+                                        GLint length;
+                                        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+                                        auto output = std::vector<char> {};
+                                        output.reserve(length + 1);
+                                        glGetProgramInfoLog(program, length, &length, &output.front());
+                                        fprintf(stderr, "error: %s while compiling program #2\n", &output.front());
+                                }
+                        }
+                        all.resolutionLocation = glGetUniformLocation(all.shaderProgram,
+                                                                      "iResolution");
+                        all.firstInstanceLocation = glGetUniformLocation(all.shaderProgram,
+                                                                         "firstInstance");
+                        // the texture units never change
+                        glUseProgram(all.shaderProgram);
+                        glUniform1i(glGetUniformLocation(all.shaderProgram, "glyphAtlas"), 0);
+                        glUniform1i(glGetUniformLocation(all.shaderProgram, "glyphInstances"), 1);
+                        glUseProgram(0);
+                }
+
+                glGenTextures(1, &all.atlasTexture);
+                glBindTexture(GL_TEXTURE_2D, all.atlasTexture);
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, atlasWidth, atlasHeight, 0, GL_RED,
+                             GL_UNSIGNED_BYTE, &atlasPixels.front());
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+                glBindTexture(GL_TEXTURE_2D, 0);
+
+                glGenTextures(1, &all.instanceTexture);
+                glBindTexture(GL_TEXTURE_BUFFER, all.instanceTexture);
+                // the whole stream, the instances of a flush starting at firstInstance
+                glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA16I, debug_string_stream().buffer());
+                glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+                // no vertex attributes, the quads come from gl_VertexID
+                glGenVertexArrays(1, &all.vertexArray);
+        }
+        return all;
+}
+
+/*
+  Lay out a message into the batch, as one instance per visible glyph.
+*/
+static void glyph_atlas_queue(float pixelX, float pixelY,
+                              char const* message,
+                              int scalePower)
+{
+        auto const& all = glyph_atlas();
+        auto& batch = gbl_debugStringBatch;
+
+        auto const glyphPx = 1 << scalePower;
+        auto x = pixelX;
+        auto y = pixelY;
+        for (auto c = message; *c && batch.instanceCount < MAX_BATCH_GLYPH_N; c++) {
+                if (*c == '\n') {
+                        x = pixelX;
+                        y += LINE_HEIGHT_PX * glyphPx;
+                        continue;
+                }
+                auto const glyph = int(*c) - FIRST_GLYPH_CHAR;
+                if (glyph < 0 || glyph >= GLYPH_N) {
+                        continue;
+                }
+                if (*c != ' ') {
+                        batch.instances[batch.instanceCount++] = {
+                                int16_t(floorf(x)), int16_t(floorf(y)), int16_t(glyph),
+                                int16_t(scalePower),
+                        };
+                }
+                x += all.glyphAdvances[glyph] * glyphPx;
+        }
+}
+
+/*
+  Upload the batch's instances in the persistent instance buffer and
+  draw them with one call.
+*/
+static void glyph_atlas_flush(uint32_t framebuffer_width_px,
+                              uint32_t framebuffer_height_px)
+{
+        auto& batch = gbl_debugStringBatch;
+        if (batch.instanceCount == 0) {
+                return;
+        }
+        auto const& all = glyph_atlas();
+
+        auto& stream = debug_string_stream();
+        auto instancesSize = batch.instanceCount * sizeof *batch.instances;
+        auto allocation = stream.map(instancesSize, sizeof *batch.instances);
+        batch.instanceCount = 0;
+        if (!allocation.data) {
+                return;
+        }
+        memcpy(allocation.data, batch.instances, instancesSize);
+        stream.unmap(&allocation, instancesSize);
+        auto instanceCount = GLsizei(instancesSize / sizeof *batch.instances);
+
         glUseProgram(all.shaderProgram);
         {
                 GLfloat resolution[] = {
@@ -237,16 +933,183 @@ void draw_debug_string(float pixelX, float pixelY,
                         static_cast<GLfloat> (framebuffer_height_px),
                         0.0,
                 };
-                glUniform3fv(glGetUniformLocation(all.shaderProgram, "iResolution"), 1,
-                             resolution);
-                glUniform1i(glGetUniformLocation(all.shaderProgram, "iFontPixelSize"),
-                            (7 << scalePower));
+                glUniform3fv(all.resolutionLocation, 1, resolution);
+                glUniform1i(all.firstInstanceLocation,
+                            GLint(allocation.offset / sizeof *batch.instances));
         }
 
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, all.atlasTexture);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_BUFFER, all.instanceTexture);
+
         glBindVertexArray(all.vertexArray);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, all.buffers[0]);
-        glDrawElements(GL_TRIANGLES, indicesCount, GL_UNSIGNED_INT, 0);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, instanceCount);
         glBindVertexArray(0);
+
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glUseProgram(0);
+
+        stream.fence();
+}
+
+static void easy_font_queue(float pixelX, float pixelY,
+                            char const* message,
+                            int scalePower)
+{
+        auto& batch = gbl_debugStringBatch;
+        auto const length = int(strlen(message));
+        if (batch.stringCount == MAX_BATCH_STRING_N ||
+            batch.textSize + length + 1 > MAX_BATCH_GLYPH_N) {
+                return;
+        }
+        batch.strings[batch.stringCount++] = {
+                pixelX, pixelY, scalePower, batch.textSize,
+        };
+        memcpy(&batch.text[batch.textSize], message, length + 1);
+        batch.textSize += length + 1;
+}
+
+static void easy_font_flush(uint32_t framebuffer_width_px,
+                            uint32_t framebuffer_height_px)
+{
+        auto& batch = gbl_debugStringBatch;
+        if (batch.stringCount == 0) {
+                return;
+        }
+        auto const& all = easy_font();
+        gbl_geometryCache.flush++;
+        geometry_cache_retire();
+
+        glUseProgram(all.shaderProgram);
+        {
+                GLfloat resolution[] = {
+                        static_cast<GLfloat> (framebuffer_width_px),
+                        static_cast<GLfloat> (framebuffer_height_px),
+                        0.0,
+                };
+                glUniform3fv(all.resolutionLocation, 1, resolution);
+        }
+        auto streamed = false;
+        for (int i = 0; i < batch.stringCount; i++) {
+                auto const& string = batch.strings[i];
+                streamed = draw_debug_string_easy_font(all, string.pixelX, string.pixelY,
+                                                       &batch.text[string.textStart],
+                                                       string.scalePower) || streamed;
+        }
         glUseProgram(0);
+        batch.stringCount = 0;
+        batch.textSize = 0;
+
+        if (streamed) {
+                debug_string_stream().fence();
+        }
+        geometry_cache_fence();
+}
+
+void draw_debug_string_queue(float pixelX, float pixelY,
+                             char const* message,
+                             int scalePower)
+{
+        switch (gbl_debugStringBackend) {
+        case DEBUG_STRING_EASY_FONT:
+                easy_font_queue(pixelX, pixelY, message, scalePower);
+                break;
+        case DEBUG_STRING_GLYPH_ATLAS:
+                glyph_atlas_queue(pixelX, pixelY, message, scalePower);
+                break;
+        }
+}
+
+void draw_debug_string_flush(uint32_t framebuffer_width_px,
+                             uint32_t framebuffer_height_px)
+{
+        // what either backend queued before a switch is still drawn
+        easy_font_flush(framebuffer_width_px, framebuffer_height_px);
+        glyph_atlas_flush(framebuffer_width_px, framebuffer_height_px);
+}
+
+/*
+  Draw a message at a pixel position, with the backend selected by
+  draw_debug_string_backend, along with the strings queued so far.
+*/
+void draw_debug_string(float pixelX, float pixelY,
+                       char const* message,
+                       int scalePower,
+                       uint32_t framebuffer_width_px,
+                       uint32_t framebuffer_height_px)
+{
+        draw_debug_string_queue(pixelX, pixelY, message, scalePower);
+        draw_debug_string_flush(framebuffer_width_px, framebuffer_height_px);
+}
+
+void DebugConsole::startLine()
+{
+        if (endLine - firstLine == LINE_N) {
+                firstLine++;
+        }
+        lines[endLine % LINE_N] = { textEnd, 0 };
+        endLine++;
+        lastLineEnded = false;
+        if (rowsFromEnd > 0) {
+                rowsFromEnd++;
+        }
+}
+
+void DebugConsole::append(char const* message)
+{
+        static_assert(int(MAX_CHAR_N) < int(TEXT_SIZE), "a whole line must fit in the text");
+        for (auto c = message; *c; c++) {
+                if (lastLineEnded) {
+                        startLine();
+                }
+                if (*c == '\n') {
+                        lastLineEnded = true;
+                        continue;
+                }
+                auto& line = lines[(endLine - 1) % LINE_N];
+                if (line.length == MAX_CHAR_N - 1) {
+                        continue;
+                }
+                // forget the lines whose text is about to be overwritten
+                while (lines[firstLine % LINE_N].start + TEXT_SIZE <= textEnd) {
+                        firstLine++;
+                }
+                text[textEnd % TEXT_SIZE] = *c;
+                textEnd++;
+                line.length++;
+        }
+}
+
+void DebugConsole::scrollBack(uint64_t rowCount)
+{
+        rowsFromEnd = rowCount;
+}
+
+int DebugConsole::visibleRowCount(float heightPx, int scalePower)
+{
+        return std::max(1, int(heightPx / (LINE_HEIGHT_PX << scalePower)));
+}
+
+void DebugConsole::draw(float pixelX, float pixelY, float heightPx, int scalePower) const
+{
+        uint64_t const rowN = visibleRowCount(heightPx, scalePower);
+        auto const scrollableN = lineCount() > rowN ? lineCount() - rowN : 0;
+        auto const lastRow = endLine - std::min(rowsFromEnd, scrollableN);
+        auto const firstRow = std::max(firstLine, lastRow > rowN ? lastRow - rowN : 0);
+
+        char row[MAX_CHAR_N];
+        auto y = pixelY;
+        for (auto lineIndex = firstRow; lineIndex < lastRow; lineIndex++) {
+                auto const& line = lines[lineIndex % LINE_N];
+                auto const start = line.start % TEXT_SIZE;
+                auto const headLength = std::min<uint64_t>(line.length, TEXT_SIZE - start);
+                memcpy(row, &text[start], headLength);
+                memcpy(row + headLength, &text[0], line.length - headLength);
+                row[line.length] = '\0';
+                draw_debug_string_queue(pixelX, y, row, scalePower);
+                y += LINE_HEIGHT_PX << scalePower;
+        }
 }
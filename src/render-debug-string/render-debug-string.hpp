@@ -8,10 +8,120 @@
 int draw_debug_string_maxchar();
 
 /**
-   Draw a string at pixel position pixelX/pixelY (top left is the origin)
+   Draw a string at pixel position pixelX/pixelY (top left is the origin),
+   along with the strings queued so far
 
    @param scalePower [0,1,2..n] selects size: [7px, 14px, 28px...7*2^npx]
 */
 void draw_debug_string(float pixelX, float pixelY, char const* message,
                        int scalePower, uint32_t framebuffer_width_px,
                        uint32_t framebuffer_height_px);
+
+/**
+   Queue a string to draw at the next draw_debug_string_flush, with the
+   same parameters as draw_debug_string.
+
+   Strings beyond the capacity of the batch are dropped.
+*/
+void draw_debug_string_queue(float pixelX, float pixelY, char const* message,
+                             int scalePower);
+
+/**
+   Draw all the queued strings, with one upload and one draw call for
+   the glyph atlas backend.
+*/
+void draw_debug_string_flush(uint32_t framebuffer_width_px,
+                             uint32_t framebuffer_height_px);
+
+enum DebugStringBackend {
+        /// quads generated by stb_easy_font, cached for repeated strings
+        DEBUG_STRING_EASY_FONT,
+        /// one instance per glyph, out of an atlas rasterized once (default)
+        DEBUG_STRING_GLYPH_ATLAS,
+};
+
+/**
+   Selects how draw_debug_string draws, from its next call on.
+*/
+void draw_debug_string_backend(DebugStringBackend backend);
+
+struct DebugStringCacheStats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+        uint32_t residentStrings;
+        uint32_t residentBytes;
+};
+
+/**
+   The easy font backend keeps the quads of the strings it drew lately
+   on the GPU, keyed by their text, position and scale, and skips both
+   stb_easy_font_print and the upload when a string is drawn again.
+   Strings enter the cache once drawn unchanged in two flushes, so that
+   strings changing every frame only count as misses.
+
+   @returns how well it did so far
+*/
+DebugStringCacheStats draw_debug_string_cache_stats();
+
+/**
+   A scrollback of text lines, such as a log, in storage of fixed size:
+   the oldest lines are forgotten as new ones come.
+
+   Drawing lays out only the rows that fit, so that its cost does not
+   depend on how long the log is. Lines are cut at
+   draw_debug_string_maxchar() characters.
+*/
+class DebugConsole
+{
+public:
+        enum {
+                LINE_N = 4096,
+                TEXT_SIZE = 256 * 1024,
+        };
+
+        /// appends text to the last line, starting a new line at every '\n'
+        void append(char const* text);
+
+        /// @returns how many lines are kept
+        uint64_t lineCount() const
+        {
+                return endLine - firstLine;
+        }
+
+        /**
+           Shows the lines ending rowCount rows before the last one, or
+           follows the last one when rowCount is 0. The view stays on the
+           same lines as more are appended.
+        */
+        void scrollBack(uint64_t rowCount);
+
+        /// @returns how many rows draw shows in heightPx
+        static int visibleRowCount(float heightPx, int scalePower);
+
+        /**
+           Queues the visible rows, from pixelX/pixelY down to at most
+           heightPx below, to be drawn by draw_debug_string_flush
+        */
+        void draw(float pixelX, float pixelY, float heightPx, int scalePower) const;
+
+private:
+        struct Line {
+                /// in text, modulo TEXT_SIZE
+                uint64_t start;
+                uint32_t length;
+        };
+
+        void startLine();
+
+        // monotonic line numbers, stored modulo LINE_N
+        Line lines[LINE_N] = {};
+        uint64_t firstLine = 0;
+        uint64_t endLine = 0;
+        bool lastLineEnded = true;
+
+        char text[TEXT_SIZE] = {};
+        uint64_t textEnd = 0;
+
+        uint64_t rowsFromEnd = 0;
+};
@@ -0,0 +1,104 @@
+#include "streaming_buffer.hpp"
+
+#include <cassert>
+
+void StreamingBuffer::init(GLenum target, GLsizeiptr capacity)
+{
+        this->target = target;
+        this->capacity = capacity;
+        glGenBuffers(1, &bufferId);
+        glBindBuffer(target, bufferId);
+        glBufferData(target, capacity, NULL, GL_STREAM_DRAW);
+        glBindBuffer(target, 0);
+}
+
+StreamingBuffer::Allocation StreamingBuffer::map(GLsizeiptr size, GLsizeiptr alignment)
+{
+        assert(alignment > 0);
+        if (size <= 0 || size > capacity) {
+                return { nullptr, 0, 0 };
+        }
+
+        auto position = (writePosition + alignment - 1) / alignment * alignment;
+        if (position % capacity + size > uint64_t(capacity)) {
+                // wrap around, leaving the end of the ring unused
+                position = (position / capacity + 1) * capacity;
+        }
+
+        retire();
+        if (position + size - retiredPosition > uint64_t(capacity)) {
+                orphan();
+                position = (position / capacity + 1) * capacity;
+                retiredPosition = position;
+        }
+        writePosition = position + size;
+
+        auto offset = GLintptr(position % capacity);
+        glBindBuffer(target, bufferId);
+        auto data = glMapBufferRange(target, offset, size,
+                                     GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT |
+                                     GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_FLUSH_EXPLICIT_BIT);
+        glBindBuffer(target, 0);
+        return { data, offset, size };
+}
+
+void StreamingBuffer::unmap(Allocation* allocation, GLsizeiptr writtenSize)
+{
+        if (!allocation->data) {
+                return;
+        }
+        assert(writtenSize <= allocation->size);
+        glBindBuffer(target, bufferId);
+        if (writtenSize > 0) {
+                glFlushMappedBufferRange(target, 0, writtenSize);
+        }
+        glUnmapBuffer(target);
+        glBindBuffer(target, 0);
+        allocation->data = nullptr;
+}
+
+void StreamingBuffer::fence()
+{
+        if (fenceCount == MAX_FENCE_N) {
+                // the newest fence is replaced by this later one, covering both
+                auto& newest = fences[(firstFence + fenceCount - 1) % MAX_FENCE_N];
+                glDeleteSync(newest.sync);
+                newest = { glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), writePosition };
+                return;
+        }
+        fences[(firstFence + fenceCount) % MAX_FENCE_N] = {
+                glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), writePosition,
+        };
+        fenceCount++;
+}
+
+/// frees what the GPU is done with, without ever waiting for it
+void StreamingBuffer::retire()
+{
+        while (fenceCount > 0) {
+                auto& oldest = fences[firstFence];
+                GLint status = GL_UNSIGNALED;
+                glGetSynciv(oldest.sync, GL_SYNC_STATUS, 1, NULL, &status);
+                if (status != GL_SIGNALED) {
+                        break;
+                }
+                retiredPosition = oldest.position;
+                glDeleteSync(oldest.sync);
+                firstFence = (firstFence + 1) % MAX_FENCE_N;
+                fenceCount--;
+        }
+}
+
+/// gives the buffer fresh storage, the driver keeping the old one until the GPU is done
+void StreamingBuffer::orphan()
+{
+        while (fenceCount > 0) {
+                glDeleteSync(fences[firstFence].sync);
+                firstFence = (firstFence + 1) % MAX_FENCE_N;
+                fenceCount--;
+        }
+        glBindBuffer(target, bufferId);
+        glBufferData(target, capacity, NULL, GL_STREAM_DRAW);
+        glBindBuffer(target, 0);
+        orphans++;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <micros/gl3.h>
+
+#include <cstdint>
+
+/**
+   A GL buffer used as a ring, for data written by the CPU every frame
+   and read by the GPU once.
+
+   Every allocation is mapped unsynchronized: the CPU writes where the
+   GPU is known to be done reading, according to the fences inserted
+   after the draws. When the GPU lags a whole ring behind, the buffer
+   storage is orphaned rather than waited for.
+
+   Needs a GL context, from init on.
+*/
+class StreamingBuffer
+{
+public:
+        struct Allocation {
+                /// where to write, nullptr once unmapped
+                void* data;
+                /// in bytes, from the start of the buffer
+                GLintptr offset;
+                GLsizeiptr size;
+        };
+
+        /**
+           Creates the buffer, of capacity bytes, bound to target while
+           mapping.
+        */
+        void init(GLenum target, GLsizeiptr capacity);
+
+        GLuint buffer() const
+        {
+                return bufferId;
+        }
+
+        /**
+           Maps size bytes starting at a multiple of alignment.
+
+           @returns an allocation without data when size exceeds the
+           capacity
+        */
+        Allocation map(GLsizeiptr size, GLsizeiptr alignment);
+
+        /**
+           Unmaps allocation, of which the first writtenSize bytes were
+           written.
+        */
+        void unmap(Allocation* allocation, GLsizeiptr writtenSize);
+
+        /**
+           Marks the end of the commands reading the allocations mapped
+           so far, after which they may be reused.
+        */
+        void fence();
+
+        /// @returns how many times the GPU lagged so much that the storage was orphaned
+        uint64_t orphanCount() const
+        {
+                return orphans;
+        }
+
+private:
+        enum {
+                MAX_FENCE_N = 64,
+        };
+
+        /// the allocations before position may be reused once sync is signaled
+        struct Fence {
+                GLsync sync;
+                uint64_t position;
+        };
+
+        void retire();
+        void orphan();
+
+        GLenum target = 0;
+        GLuint bufferId = 0;
+        GLsizeiptr capacity = 0;
+
+        // monotonic positions in bytes, their ring offset modulo capacity
+        uint64_t writePosition = 0;
+        uint64_t retiredPosition = 0;
+
+        // oldest first
+        Fence fences[MAX_FENCE_N] = {};
+        int firstFence = 0;
+        int fenceCount = 0;
+
+        uint64_t orphans = 0;
+};